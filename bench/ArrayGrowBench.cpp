@@ -0,0 +1,101 @@
+#include "Bench.h"
+#include "LargeAllocator.h"
+#include "ScratchAllocator.h"
+#include "SmallArray.h"
+
+// push_back from empty, every doubling either copies into a new block or grows the old one.
+template<typename T>
+static BenchResult push_back_run(const char* name, Allocator& allocator, u64 n, const BenchOptions& options)
+{
+	return bench_run(name, n, [&] {
+		Array<T> a(allocator);
+		for (u64 i = 0; i < n; ++i)
+		{
+			a.push_back((T)i);
+		}
+		bench_sink((u64)a[(i32)(n - 1)]);
+	}, options);
+}
+
+// Large arrays: malloc copies on every doubling, LargeAllocator and the scratch pad's oversize
+// allocations remap. Small arrays on a scratch pad: the newest allocation is bumped in place
+// instead of leaving its old copy behind.
+void bench_array_growth(const BenchConfig& config, Array<BenchResult>& results)
+{
+	const u64 large = config.quick ? (1 << 22) : (1 << 26);
+	const u64 small = 1 << 20;
+	const i32 first = results.size();
+
+	BenchOptions options;
+	options.warmups = 1;
+	options.samples = config.quick ? 3 : 7;
+
+	MallocAllocator ma;
+	LargeAllocator la;
+	results.push_back(push_back_run<u64>(bench_name("array/push_back/malloc/%llu", large), ma, large, options));
+	results.push_back(push_back_run<u64>(bench_name("array/push_back/large/%llu", large), la, large, options));
+	results.push_back(bench_run(bench_name("array/push_back/scratch/%llu", large), large, [&] {
+		ScratchPadAllocator sa;
+		Array<u64> a(sa);
+		for (u64 i = 0; i < large; ++i)
+		{
+			a.push_back(i);
+		}
+		bench_sink(a[(i32)(large - 1)]);
+	}, options));
+
+	results.push_back(push_back_run<u8>(bench_name("array/push_back/malloc/%llu", small), ma, small, options));
+	results.push_back(bench_run(bench_name("array/push_back/scratch/%llu", small), small, [&] {
+		ScratchPadAllocator sa;
+		Array<u8> a(sa);
+		for (u64 i = 0; i < small; ++i)
+		{
+			a.push_back((u8)i);
+		}
+		bench_sink(a[(i32)(small - 1)]);
+	}, options));
+
+	// Per record arrays of under 16 elements, each one built, summed and dropped.
+	const u64 records = config.quick ? (1 << 18) : (1 << 21);
+	results.push_back(bench_run(bench_name("array/records_under_16/array/%llu", records), records, [&] {
+		u64 rng = 1;
+		u64 sum = 0;
+		for (u64 r = 0; r < records; ++r)
+		{
+			Array<u32> a(ma);
+			const u32 n = (u32)(bench_random(rng) % 16);
+			for (u32 i = 0; i < n; ++i)
+			{
+				a.push_back(i);
+			}
+			for (u32 v : a)
+			{
+				sum += v;
+			}
+		}
+		bench_sink(sum);
+	}, options));
+	results.push_back(bench_run(bench_name("array/records_under_16/small_array/%llu", records), records, [&] {
+		u64 rng = 1;
+		u64 sum = 0;
+		for (u64 r = 0; r < records; ++r)
+		{
+			SmallArray<u32, 16> a(ma);
+			const u32 n = (u32)(bench_random(rng) % 16);
+			for (u32 i = 0; i < n; ++i)
+			{
+				a.push_back(i);
+			}
+			for (u32 v : a)
+			{
+				sum += v;
+			}
+		}
+		bench_sink(sum);
+	}, options));
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Array.h"
+#include "Benchmark.h"
+#include "Core.h"
+
+struct BenchConfig
+{
+	bool quick = false;
+	u64 max_elements = 1ULL << 22;
+	// Final size of the per insert latency runs.
+	u64 growth_elements = 50000000;
+};
+
+// Result names live for the whole run, formatted into one scratch allocator.
+const char* bench_name(const char* fmt, ...);
+
+// Keeps measured results alive without the optimizer seeing through them.
+void bench_sink(u64 value);
+
+// splitmix64, deterministic key streams for every suite.
+inline u64 bench_random(u64& state)
+{
+	u64 z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// Nearest rank percentile of sorted latencies, p in [0, 1].
+inline u32 latency_percentile(const Array<u32>& sorted, double p)
+{
+	u64 rank = (u64)(p * sorted.size() + 0.999999);
+	rank = rank < 1 ? 1 : (rank > (u64)sorted.size() ? (u64)sorted.size() : rank);
+	return sorted[(i32)(rank - 1)];
+}
+
+void bench_hash_tables(const BenchConfig& config, Array<BenchResult>& results);
+void bench_swiss_iteration(const BenchConfig& config, Array<BenchResult>& results);
+void bench_string_keys(const BenchConfig& config, Array<BenchResult>& results);
+void bench_swiss_churn(const BenchConfig& config, Array<BenchResult>& results);
+void bench_swiss_batch(const BenchConfig& config, Array<BenchResult>& results);
+void bench_concurrent(const BenchConfig& config, Array<BenchResult>& results);
+void bench_snapshot(const BenchConfig& config, Array<BenchResult>& results);
+void bench_wyhash(const BenchConfig& config, Array<BenchResult>& results);
+void bench_array_growth(const BenchConfig& config, Array<BenchResult>& results);
+void bench_probe_lengths(const BenchConfig& config);
+void bench_scratch_threads(const BenchConfig& config);
+void bench_scratch_requests(const BenchConfig& config, Array<BenchResult>& results);
+void bench_scratch_spike(const BenchConfig& config);
+void bench_grow_latency(const BenchConfig& config);
+void bench_allocator_tracking(const BenchConfig& config, Array<BenchResult>& results);
+void bench_pool(const BenchConfig& config, Array<BenchResult>& results);
+void bench_tlsf(const BenchConfig& config, Array<BenchResult>& results);
+void bench_soa(const BenchConfig& config, Array<BenchResult>& results);
@@ -0,0 +1,125 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Bench.h"
+#include "ScratchAllocator.h"
+
+static ScratchPadAllocator* s_names = nullptr;
+static volatile u64 s_sink = 0;
+
+const char* bench_name(const char* fmt, ...)
+{
+	char buffer[256];
+	va_list args;
+	va_start(args, fmt);
+	i32 len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+
+	len = len < (i32)sizeof(buffer) ? len : (i32)sizeof(buffer) - 1;
+	char* name = (char*)s_names->alloc(len + 1);
+	memcpy(name, buffer, len + 1);
+	return name;
+}
+
+void bench_sink(u64 value)
+{
+	s_sink = s_sink + value;
+}
+
+static void usage()
+{
+	puts("lime_bench [--quick] [--max-elements N] [--growth-elements N] [--filter SUBSTRING] [--json PATH]");
+}
+
+int main(int argc, char** argv)
+{
+	BenchConfig config;
+	const char* jsonPath = nullptr;
+	const char* filter = nullptr;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--quick") == 0)
+		{
+			config.quick = true;
+			config.max_elements = 1 << 18;
+			config.growth_elements = 1 << 20;
+		}
+		else if (strcmp(argv[i], "--max-elements") == 0 && i + 1 < argc)
+			config.max_elements = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--growth-elements") == 0 && i + 1 < argc)
+			config.growth_elements = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			jsonPath = argv[++i];
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	block_memory_init();
+	{
+		MallocAllocator ma;
+		ScratchPadAllocator names;
+		s_names = &names;
+
+		Array<BenchResult> results(ma);
+
+		if (!filter || strstr("hash", filter))
+			bench_hash_tables(config, results);
+		if (!filter || strstr("iterate", filter))
+			bench_swiss_iteration(config, results);
+		if (!filter || strstr("string", filter))
+			bench_string_keys(config, results);
+		if (!filter || strstr("churn", filter))
+			bench_swiss_churn(config, results);
+		if (!filter || strstr("batch", filter))
+			bench_swiss_batch(config, results);
+		if (!filter || strstr("concurrent", filter))
+			bench_concurrent(config, results);
+		if (!filter || strstr("snapshot", filter))
+			bench_snapshot(config, results);
+		if (!filter || strstr("wyhash", filter))
+			bench_wyhash(config, results);
+		if (!filter || strstr("array", filter))
+			bench_array_growth(config, results);
+		if (!filter || strstr("probe", filter))
+			bench_probe_lengths(config);
+		if (!filter || strstr("scratch", filter))
+		{
+			bench_scratch_threads(config);
+			bench_scratch_requests(config, results);
+			bench_scratch_spike(config);
+		}
+		if (!filter || strstr("latency", filter))
+			bench_grow_latency(config);
+		if (!filter || strstr("tracking", filter))
+			bench_allocator_tracking(config, results);
+		if (!filter || strstr("pool", filter))
+			bench_pool(config, results);
+		if (!filter || strstr("tlsf", filter))
+			bench_tlsf(config, results);
+		if (!filter || strstr("soa", filter))
+			bench_soa(config, results);
+
+		if (jsonPath)
+		{
+			FILE* f = fopen(jsonPath, "w");
+			if (!f)
+			{
+				printf("Could not open %s\n", jsonPath);
+				return 1;
+			}
+			bench_write_json(f, results.begin(), results.size());
+			fclose(f);
+		}
+
+		s_names = nullptr;
+	}
+	block_memory_shutdown();
+}
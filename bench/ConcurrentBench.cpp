@@ -0,0 +1,117 @@
+#include <mutex>
+#include <thread>
+
+#include "Bench.h"
+#include "ConcurrentSwissTable.h"
+
+// The setup being replaced: one SwissTable behind one global mutex.
+struct GlobalMutexTable
+{
+	bool find(u64 key, u64& out)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		const u64* v = table.find(key);
+		if (v)
+			out = *v;
+		return v != nullptr;
+	}
+
+	void insert_or_assign(u64 key, u64 value)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		table.insert_or_assign(key, value);
+	}
+
+	bool erase(u64 key)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return table.erase(key);
+	}
+
+	std::mutex lock;
+	SwissTable<u64, u64> table;
+};
+
+// Each thread does ops operations over a key space twice the prefilled size. Writes alternate
+// between insert_or_assign and erase so the table size stays put.
+template<typename Table>
+static double run_mix(Table& table, u32 threads, u32 ops, u32 writePercent, u64 keySpace)
+{
+	auto worker = [&](u32 id) {
+		u64 rng = id * 7919 + 1;
+		u64 sum = 0;
+		for (u32 i = 0; i < ops; ++i)
+		{
+			const u64 r = bench_random(rng);
+			const u64 key = r % keySpace;
+			if ((r >> 40) % 100 < writePercent)
+			{
+				if (r & (1ULL << 63))
+					table.insert_or_assign(key, i);
+				else
+					table.erase(key);
+			}
+			else
+			{
+				u64 value;
+				sum += table.find(key, value) ? value : 0;
+			}
+		}
+		bench_sink(sum);
+	};
+
+	std::thread workers[64];
+	Timer t;
+	timer_init(&t);
+	timer_start(&t);
+	for (u32 i = 0; i < threads; ++i)
+	{
+		workers[i] = std::thread(worker, i);
+	}
+	for (u32 i = 0; i < threads; ++i)
+	{
+		workers[i].join();
+	}
+	return timer_elapsed_ms(&t);
+}
+
+void bench_concurrent(const BenchConfig& config, Array<BenchResult>& results)
+{
+	static constexpr u32 WRITE_PERCENT[] = {5, 50};
+	const u64 prefill = config.quick ? (1 << 16) : (1 << 20);
+	const u32 ops = config.quick ? 100000 : 1000000;
+
+	u32 maxThreads = 64;
+	if (config.quick)
+	{
+		maxThreads = std::thread::hardware_concurrency();
+		maxThreads = maxThreads < 1 ? 1 : (maxThreads > 64 ? 64 : maxThreads);
+	}
+
+	for (u32 write : WRITE_PERCENT)
+	{
+		for (u32 threads = 1; threads <= maxThreads; threads *= 2)
+		{
+			ConcurrentSwissTable<u64, u64> sharded;
+			GlobalMutexTable global;
+			for (u64 i = 0; i < prefill; ++i)
+			{
+				sharded.insert_or_assign(i * 2, i);
+				global.insert_or_assign(i * 2, i);
+			}
+
+			const double shardedMs = run_mix(sharded, threads, ops, write, prefill * 2);
+			const double globalMs = run_mix(global, threads, ops, write, prefill * 2);
+			const double totalOps = (double)threads * ops;
+
+			printf("concurrent %2u%% writes %2u threads: sharded %7.2f Mops/s  global mutex %7.2f Mops/s\n",
+				write, threads, totalOps / (shardedMs * 1000.0), totalOps / (globalMs * 1000.0));
+
+			// One sample each, ns/op is wall time over all threads' operations.
+			double sample = shardedMs;
+			results.push_back(bench_summarize(bench_name("concurrent/sharded/%u%%_writes/%u_threads", write, threads), (u64)totalOps, &sample, 1));
+			sample = globalMs;
+			results.push_back(bench_summarize(bench_name("concurrent/global_mutex/%u%%_writes/%u_threads", write, threads), (u64)totalOps, &sample, 1));
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+
+#include "Bench.h"
+#include "HashMap.h"
+#include "SwissTable.h"
+
+struct SwissGrowth
+{
+	static const char* name() { return "swiss"; }
+
+	explicit SwissGrowth(bool incremental) { table.set_incremental_rehash(incremental); }
+
+	void insert(u64 key, u64 value) { table.insert(key, value); }
+
+	SwissTable<u64, u64> table;
+};
+
+struct ChainedGrowth
+{
+	static const char* name() { return "chained"; }
+
+	explicit ChainedGrowth(bool incremental) { table.incremental = incremental; }
+
+	void insert(u64 key, u64 value) { hashtable::insert(table, key, value); }
+
+	hashtable::Hashtable<u64> table;
+};
+
+// Times every insert on its own while the table grows from empty, so the inserts that cross the load
+// factor show up in the tail instead of disappearing into an average.
+template<typename Table>
+static void grow_latency(u64 n, bool incremental, Array<u32>& latencies)
+{
+	Timer timer;
+	timer_init(&timer);
+
+	Timer total;
+	timer_init(&total);
+	timer_start(&total);
+
+	{
+		Table t(incremental);
+		u64 rng = 1;
+		for (u64 i = 0; i < n; ++i)
+		{
+			const u64 key = bench_random(rng);
+			timer_start(&timer);
+			t.insert(key, i);
+			latencies[(i32)i] = (u32)(timer_elapsed_ms(&timer) * 1000000.0);
+		}
+	}
+
+	const double totalMs = timer_elapsed_ms(&total);
+
+	std::sort(latencies.begin(), latencies.end());
+
+	printf("%-8s %-14s %llu inserts  total %9.1f ms  p50 %5u  p99 %6u  p99.9 %7u  p99.99 %8u  max %10u ns\n",
+		Table::name(), incremental ? "incremental" : "stop_the_world", n, totalMs,
+		latency_percentile(latencies, 0.5), latency_percentile(latencies, 0.99),
+		latency_percentile(latencies, 0.999), latency_percentile(latencies, 0.9999),
+		latencies[latencies.size() - 1]);
+}
+
+// Per insert latency from 0 to growth_elements, stop-the-world rehashing against incremental. The
+// chained table's entry array still doubles by copy, only its bucket relinking is spread out.
+void bench_grow_latency(const BenchConfig& config)
+{
+	const u64 n = config.growth_elements;
+
+	MallocAllocator ma;
+	Array<u32> latencies(ma);
+	latencies.resize_uninit((i32)n);
+
+	grow_latency<SwissGrowth>(n, false, latencies);
+	grow_latency<SwissGrowth>(n, true, latencies);
+	grow_latency<ChainedGrowth>(n, false, latencies);
+	grow_latency<ChainedGrowth>(n, true, latencies);
+}
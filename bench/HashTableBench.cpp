@@ -0,0 +1,362 @@
+#include <unordered_map>
+
+#include "Bench.h"
+#include "HashMap.h"
+#include "SwissTable.h"
+
+template<u32 N>
+struct Value
+{
+	u8 bytes[N];
+};
+
+template<typename V>
+struct SwissAdapter
+{
+	static constexpr bool CAN_ERASE = true;
+	static const char* name() { return "swiss"; }
+
+	SwissTable<u64, V> table;
+
+	void insert(u64 key, const V& value) { table.insert(key, value); }
+	const V* find(u64 key) { return table.find(key); }
+	void erase(u64 key) { table.erase(key); }
+};
+
+template<typename V>
+struct ChainedAdapter
+{
+	static constexpr bool CAN_ERASE = true;
+	static const char* name() { return "chained"; }
+
+	hashtable::Hashtable<V> table;
+
+	void insert(u64 key, const V& value)
+	{
+		V copy = value;
+		hashtable::insert(table, key, copy);
+	}
+
+	const V* find(u64 key) { return hashtable::find(table, key); }
+	void erase(u64 key) { hashtable::erase(table, key); }
+};
+
+template<typename V>
+struct StdAdapter
+{
+	static constexpr bool CAN_ERASE = true;
+	static const char* name() { return "std"; }
+
+	std::unordered_map<u64, V> table;
+
+	void insert(u64 key, const V& value) { table.emplace(key, value); }
+
+	const V* find(u64 key)
+	{
+		auto it = table.find(key);
+		return it != table.end() ? &it->second : nullptr;
+	}
+
+	void erase(u64 key) { table.erase(key); }
+};
+
+struct KeySet
+{
+	explicit KeySet(Allocator& a)
+		: present(a)
+		, lookups{Array<u64>(a), Array<u64>(a), Array<u64>(a)}
+	{
+	}
+
+	Array<u64> present;
+	Array<u64> lookups[3]; // 100%, 50% and 0% hits
+};
+
+static constexpr u32 HIT_PERCENT[3] = {100, 50, 0};
+
+// Present keys have the low bit clear and missing keys have it set, so the two sets never overlap.
+static void make_keys(KeySet& keys, u64 n)
+{
+	u64 rng = n;
+	keys.present.resize((i32)n);
+	for (u64 i = 0; i < n; ++i)
+	{
+		keys.present[(i32)i] = bench_random(rng) & ~1ULL;
+	}
+
+	for (u32 r = 0; r < 3; ++r)
+	{
+		keys.lookups[r].resize((i32)n);
+		for (u64 i = 0; i < n; ++i)
+		{
+			bool hit = bench_random(rng) % 100 < HIT_PERCENT[r];
+			u64 key = keys.present[(i32)(bench_random(rng) % n)];
+			keys.lookups[r][(i32)i] = hit ? key : key | 1;
+		}
+	}
+}
+
+static BenchOptions options_for(u64 n, const BenchConfig& config)
+{
+	BenchOptions options;
+	options.warmups = 1;
+	options.samples = n >= (1 << 20) ? 3 : (config.quick ? 5 : 15);
+	return options;
+}
+
+template<template<typename> class Table, u32 N>
+void bench_table(const BenchConfig& config, const KeySet& keys, u64 n, Array<BenchResult>& results)
+{
+	using V = Value<N>;
+	const BenchOptions options = options_for(n, config);
+	const char* table = Table<V>::name();
+	const i32 first = results.size();
+
+	V value;
+	memset(&value, 1, sizeof(V));
+
+	results.push_back(bench_run(bench_name("%s/insert/%uB/%llu", table, N, n), n, [&] {
+		Table<V> t;
+		for (u64 i = 0; i < n; ++i)
+		{
+			t.insert(keys.present[(i32)i], value);
+		}
+	}, options));
+
+	{
+		Table<V> t;
+		for (u64 i = 0; i < n; ++i)
+		{
+			t.insert(keys.present[(i32)i], value);
+		}
+
+		for (u32 r = 0; r < 3; ++r)
+		{
+			const Array<u64>& lookups = keys.lookups[r];
+			results.push_back(bench_run(bench_name("%s/find_%u%%/%uB/%llu", table, HIT_PERCENT[r], N, n), n, [&] {
+				u64 found = 0;
+				for (u64 i = 0; i < n; ++i)
+				{
+					const V* v = t.find(lookups[(i32)i]);
+					found += v ? v->bytes[0] : 0;
+				}
+				bench_sink(found);
+			}, options));
+		}
+	}
+
+	// Churn starts from a fresh table every sample and replaces a quarter of it, one erase and one insert per op.
+	if constexpr (Table<V>::CAN_ERASE)
+	{
+		const u64 churn = n / 4;
+		Table<V>* t = nullptr;
+		results.push_back(bench_run_with_setup(bench_name("%s/churn/%uB/%llu", table, N, n), churn, [&] {
+			delete t;
+			t = new Table<V>();
+			for (u64 i = 0; i < n - churn; ++i)
+			{
+				t->insert(keys.present[(i32)i], value);
+			}
+		}, [&] {
+			for (u64 i = 0; i < churn; ++i)
+			{
+				t->erase(keys.present[(i32)i]);
+				t->insert(keys.present[(i32)(n - churn + i)], value);
+			}
+		}, options));
+		delete t;
+	}
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+}
+
+// Bulk build against one insert per key, then lookups into the bucket ordered result.
+static void bench_chained_build(const BenchConfig& config, const KeySet& keys, u64 n, Array<BenchResult>& results)
+{
+	using V = Value<16>;
+	const BenchOptions options = options_for(n, config);
+	const i32 first = results.size();
+
+	MallocAllocator ma;
+	Array<V> values(ma);
+	values.resize((i32)n);
+	memset(values.begin(), 1, sizeof(V) * n);
+
+	results.push_back(bench_run(bench_name("chained/insert_loop/%llu", n), n, [&] {
+		hashtable::Hashtable<V> t;
+		for (u64 i = 0; i < n; ++i)
+		{
+			V copy = values[(i32)i];
+			hashtable::insert(t, keys.present[(i32)i], copy);
+		}
+	}, options));
+
+	hashtable::Hashtable<V> built;
+	results.push_back(bench_run(bench_name("chained/build/%llu", n), n, [&] {
+		hashtable::build(built, keys.present.begin(), values.begin(), (u32)n);
+	}, options));
+
+	const Array<u64>& lookups = keys.lookups[0];
+	results.push_back(bench_run(bench_name("chained/find_built/%llu", n), n, [&] {
+		u64 found = 0;
+		for (u64 i = 0; i < n; ++i)
+		{
+			const V* v = hashtable::find(built, lookups[(i32)i]);
+			found += v ? v->bytes[0] : 0;
+		}
+		bench_sink(found);
+	}, options));
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+}
+
+template<u32 N>
+void bench_value_size(const BenchConfig& config, const KeySet& keys, u64 n, Array<BenchResult>& results)
+{
+	bench_table<SwissAdapter, N>(config, keys, n, results);
+	bench_table<ChainedAdapter, N>(config, keys, n, results);
+	bench_table<StdAdapter, N>(config, keys, n, results);
+}
+
+// 1K entries sit in L1/L2, 16K in L2, 256K in the LLC on most parts, 4M is well beyond it.
+void bench_hash_tables(const BenchConfig& config, Array<BenchResult>& results)
+{
+	static constexpr u64 SIZES[] = {1 << 10, 1 << 14, 1 << 18, 1 << 22};
+	// Largest tables only with the small values, a 4M x 256B table does not say anything new.
+	static constexpr u64 MAX_BYTES = 256ULL << 20;
+
+	MallocAllocator ma;
+
+	for (u64 n : SIZES)
+	{
+		if (n > config.max_elements)
+			break;
+
+		KeySet keys(ma);
+		make_keys(keys, n);
+
+		bench_chained_build(config, keys, n, results);
+		bench_value_size<4>(config, keys, n, results);
+		bench_value_size<16>(config, keys, n, results);
+		if (n * 64 <= MAX_BYTES)
+			bench_value_size<64>(config, keys, n, results);
+		if (n * 256 <= MAX_BYTES)
+			bench_value_size<256>(config, keys, n, results);
+	}
+}
+
+static u64 key_sequential(u64 i) { return i; }
+static u64 key_strided(u64 i) { return i * 10; }
+static u64 key_pointer(u64 i) { return 0x00007f3a40000000ULL + i * 64; }
+static u64 key_adversarial(u64 i) { return i << 32; }
+static u64 key_prehashed(u64 i) { return wyhash::hash(i); }
+
+template<typename Hasher>
+void probe_lengths(const char* hasherName, const char* keysName, u64 (*make_key)(u64), u32 n)
+{
+	SwissTable<u64, u32, Hasher> table;
+	for (u32 i = 0; i < n; ++i)
+	{
+		table.insert(make_key(i), i);
+	}
+
+	u64 total = 0;
+	u32 longest = 0;
+	for (u32 i = 0; i < n; ++i)
+	{
+		u32 len = table.probe_length(make_key(i));
+		total += len;
+		longest = len > longest ? len : longest;
+	}
+
+	printf("%-8s %-12s groups probed avg %.2f max %u\n", hasherName, keysName, (double)total / n, longest);
+}
+
+void bench_probe_lengths(const BenchConfig& config)
+{
+	const u32 n = config.quick ? 100000 : 1000000;
+
+	probe_lengths<WyHash>("wyhash", "sequential", key_sequential, n);
+	probe_lengths<WyHash>("wyhash", "strided", key_strided, n);
+	probe_lengths<WyHash>("wyhash", "pointer", key_pointer, n);
+	probe_lengths<WyHash>("wyhash", "adversarial", key_adversarial, n);
+
+	probe_lengths<IdentityHash>("identity", "prehashed", key_prehashed, n);
+}
+
+template<typename Table>
+static void bench_scans(const char* state, const Table& t, Array<BenchResult>& results, const BenchOptions& options)
+{
+	const i32 first = results.size();
+
+	results.push_back(bench_run(bench_name("swiss/scan_bytes/%s", state), t.size, [&] {
+		u64 sum = 0;
+		for (u32 i = 0; i < t.capacity; ++i)
+		{
+			if (t.control[i] != DELETED && t.control[i] != EMPTY)
+				sum += t.data[i].value;
+		}
+		bench_sink(sum);
+	}, options));
+
+	results.push_back(bench_run(bench_name("swiss/scan_iterator/%s", state), t.size, [&] {
+		u64 sum = 0;
+		for (auto& e : t)
+		{
+			sum += e.value;
+		}
+		bench_sink(sum);
+	}, options));
+
+	results.push_back(bench_run(bench_name("swiss/scan_for_each/%s", state), t.size, [&] {
+		u64 sum = 0;
+		t.for_each([&](u64, const u64& value) { sum += value; });
+		bench_sink(sum);
+	}, options));
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+}
+
+// Full scans over a fixed capacity at falling occupancy, then after a mass erase.
+void bench_swiss_iteration(const BenchConfig& config, Array<BenchResult>& results)
+{
+	const u32 capacity = config.quick ? (1 << 18) : (1 << 22);
+	BenchOptions options;
+	options.samples = config.quick ? 5 : 15;
+
+	static constexpr u32 FILL_PERCENT[] = {65, 25, 5};
+	for (u32 fill : FILL_PERCENT)
+	{
+		SwissTable<u64, u64> t(capacity);
+		u64 rng = fill;
+		for (u32 i = 0; i < capacity / 100 * fill; ++i)
+		{
+			t.insert(bench_random(rng), i);
+		}
+		bench_scans(bench_name("%u%%_full", fill), t, results, options);
+	}
+
+	SwissTable<u64, u64> t(capacity);
+	u64 rng = 1;
+	for (u32 i = 0; i < capacity / 100 * 65; ++i)
+	{
+		t.insert(bench_random(rng), i);
+	}
+	rng = 1;
+	for (u32 i = 0; i < capacity / 100 * 65; ++i)
+	{
+		u64 key = bench_random(rng);
+		if (i % 10)
+			t.erase(key);
+	}
+	bench_scans("65%_then_90%_erased", t, results, options);
+}
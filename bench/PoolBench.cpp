@@ -0,0 +1,195 @@
+#include <thread>
+
+#include "Bench.h"
+#include "PoolAllocator.h"
+
+// An alloc when size is set, otherwise a free of whatever slot holds.
+struct TraceOp
+{
+	u32 size;
+	u32 slot;
+};
+
+static constexpr u32 TRACE_SLOTS = 1 << 16;
+
+// Mostly small sizes with a long tail up to the largest class. Live blocks wander between half and
+// all of TRACE_SLOTS and are freed in random order, neither scoped nor LIFO.
+static void make_trace(Array<TraceOp>& trace, u64 ops, u64 seed)
+{
+	MallocAllocator ma;
+	Array<u32> live(ma);
+	Array<u32> idle(ma);
+	for (u32 i = 0; i < TRACE_SLOTS; ++i)
+	{
+		idle.push_back(TRACE_SLOTS - 1 - i);
+	}
+
+	u64 rng = seed;
+	trace.resize_uninit((i32)ops);
+	for (u64 i = 0; i < ops; ++i)
+	{
+		const u64 r = bench_random(rng);
+		const bool alloc = live.size() < (i32)TRACE_SLOTS / 2 || (idle.size() > 0 && (r & 1));
+		TraceOp& op = trace[(i32)i];
+
+		if (alloc)
+		{
+			const u32 bucket = (u32)((r >> 8) % 100);
+			const u32 maxSize = bucket < 60 ? 128 : (bucket < 90 ? 1024 : (bucket < 99 ? 8192 : 32768));
+			op.size = 16 + (u32)((r >> 16) % (maxSize - 15));
+			op.slot = idle[idle.size() - 1];
+			idle.resize(idle.size() - 1);
+			live.push_back(op.slot);
+		}
+		else
+		{
+			const i32 pick = (i32)((r >> 16) % (u64)live.size());
+			op.size = 0;
+			op.slot = live[pick];
+			live[pick] = live[live.size() - 1];
+			live.resize(live.size() - 1);
+			idle.push_back(op.slot);
+		}
+	}
+}
+
+static void run_trace(Allocator& allocator, const Array<TraceOp>& trace)
+{
+	struct Live
+	{
+		u8* block;
+		u32 size;
+	};
+	static thread_local Live slots[TRACE_SLOTS];
+
+	for (const TraceOp& op : trace)
+	{
+		Live& live = slots[op.slot];
+		if (op.size)
+		{
+			live.block = (u8*)allocator.alloc(op.size);
+			live.size = op.size;
+			live.block[0] = (u8)op.size;
+		}
+		else
+		{
+			allocator.free(live.block, live.size);
+			live.block = nullptr;
+		}
+	}
+
+	for (Live& live : slots)
+	{
+		if (live.block)
+			allocator.free(live.block, live.size);
+		live.block = nullptr;
+	}
+}
+
+// Thousands of arrays grown from empty in random order, each growth frees the last buffer.
+static void grow_arrays(Allocator& allocator, u64 n)
+{
+	constexpr u32 ARRAYS = 4096;
+	MallocAllocator ma;
+	Array<Array<u32>*> arrays(ma);
+	for (u32 a = 0; a < ARRAYS; ++a)
+	{
+		arrays.push_back(new Array<u32>(allocator));
+	}
+
+	u64 rng = 1;
+	for (u64 i = 0; i < n; ++i)
+	{
+		arrays[(i32)(bench_random(rng) % ARRAYS)]->push_back((u32)i);
+	}
+
+	for (Array<u32>* a : arrays)
+	{
+		delete a;
+	}
+}
+
+// A randomized alloc/free trace against malloc, on one thread and split into one trace per core
+// sharing a pool with magazines. Then small Array buffers, which plug into the pool unchanged.
+void bench_pool(const BenchConfig& config, Array<BenchResult>& results)
+{
+	constexpr u32 MAX_THREADS = 64;
+	const u64 ops = config.quick ? (1 << 21) : (1 << 24);
+	const i32 first = results.size();
+
+	u32 threads = std::thread::hardware_concurrency();
+	threads = threads < 2 ? 2 : (threads > MAX_THREADS ? MAX_THREADS : threads);
+
+	BenchOptions options;
+	options.warmups = 1;
+	options.samples = config.quick ? 5 : 11;
+
+	MallocAllocator ma;
+	Array<TraceOp> trace(ma);
+	make_trace(trace, ops, 1);
+
+	Array<Array<TraceOp>*> traces(ma);
+	for (u32 t = 0; t < threads; ++t)
+	{
+		traces.push_back(new Array<TraceOp>(ma));
+		make_trace(*traces[(i32)t], ops / threads, t + 2);
+	}
+
+	results.push_back(bench_run(bench_name("pool/trace/malloc/%llu", ops), ops, [&] {
+		run_trace(ma, trace);
+	}, options));
+
+	results.push_back(bench_run(bench_name("pool/trace/pool/%llu", ops), ops, [&] {
+		PoolAllocator pool;
+		run_trace(pool, trace);
+	}, options));
+
+	PoolConfig magazines;
+	magazines.thread_magazines = true;
+	results.push_back(bench_run(bench_name("pool/trace/pool_magazines/%llu", ops), ops, [&] {
+		PoolAllocator pool(magazines);
+		run_trace(pool, trace);
+	}, options));
+
+	auto threaded = [&](Allocator& allocator) {
+		std::thread workers[MAX_THREADS];
+		for (u32 t = 0; t < threads; ++t)
+		{
+			workers[t] = std::thread([&, t] { run_trace(allocator, *traces[(i32)t]); });
+		}
+		for (u32 t = 0; t < threads; ++t)
+		{
+			workers[t].join();
+		}
+	};
+
+	const u64 threadedOps = ops / threads * threads;
+	results.push_back(bench_run(bench_name("pool/trace_%u_threads/malloc/%llu", threads, threadedOps), threadedOps, [&] {
+		threaded(ma);
+	}, options));
+
+	results.push_back(bench_run(bench_name("pool/trace_%u_threads/pool_magazines/%llu", threads, threadedOps), threadedOps, [&] {
+		PoolAllocator pool(magazines);
+		threaded(pool);
+	}, options));
+
+	const u64 pushes = ops * 4;
+	results.push_back(bench_run(bench_name("pool/grow_arrays/malloc/%llu", pushes), pushes, [&] {
+		grow_arrays(ma, pushes);
+	}, options));
+
+	results.push_back(bench_run(bench_name("pool/grow_arrays/pool/%llu", pushes), pushes, [&] {
+		PoolAllocator pool;
+		grow_arrays(pool, pushes);
+	}, options));
+
+	for (Array<TraceOp>* t : traces)
+	{
+		delete t;
+	}
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+}
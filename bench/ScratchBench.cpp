@@ -0,0 +1,168 @@
+#include <cstdio>
+#include <thread>
+
+#include "Bench.h"
+#include "ScratchAllocator.h"
+
+static void scratch_worker(int iterations)
+{
+	for (int i = 0; i < iterations; ++i)
+	{
+		// Four thirds of a block, so every allocator takes and returns a chain of two
+		ScratchPadAllocator sa;
+		for (int a = 0; a < 4; ++a)
+		{
+			sa.alloc(Block::BLOCK_SIZE / 3);
+		}
+	}
+}
+
+void bench_scratch_threads(const BenchConfig& config)
+{
+	constexpr u32 MAX_THREADS = 64;
+	const int iterations = config.quick ? 10000 : 100000;
+
+	u32 cores = std::thread::hardware_concurrency();
+	cores = cores < 1 ? 1 : (cores > MAX_THREADS ? MAX_THREADS : cores);
+
+	Timer t;
+	timer_init(&t);
+
+	for (u32 threads = 1;; threads *= 2)
+	{
+		threads = threads > cores ? cores : threads;
+
+		std::thread workers[MAX_THREADS];
+		timer_start(&t);
+		for (u32 i = 0; i < threads; ++i)
+		{
+			workers[i] = std::thread(scratch_worker, iterations);
+		}
+		for (u32 i = 0; i < threads; ++i)
+		{
+			workers[i].join();
+		}
+		double ms = timer_elapsed_ms(&t);
+
+		printf("Scratch allocators %2u threads: %.2f M/s\n", threads, threads * iterations / (ms * 1000.0));
+
+		if (threads == cores)
+			break;
+	}
+}
+
+// One request's temporaries, bytes in total from a few hundred byte allocations up to 64 KB ones.
+static void scratch_request(ScratchPadAllocator& sa, u64 bytes, u64 maxSize, u64& rng)
+{
+	for (u64 total = 0; total < bytes;)
+	{
+		const u64 size = 64 + bench_random(rng) % maxSize;
+		u8* p = (u8*)sa.alloc(size);
+		p[0] = (u8)size;
+		total += size;
+	}
+}
+
+// A fresh allocator per request against one long lived allocator rewound by a scope, for requests
+// that fit in a block and for ones that spill into a second.
+void bench_scratch_requests(const BenchConfig& config, Array<BenchResult>& results)
+{
+	struct Shape
+	{
+		const char* name;
+		u64 bytes;
+		u64 maxSize;
+	};
+	static constexpr Shape SHAPES[] = {{"16KB", 16 << 10, 1024}, {"1.5_blocks", Block::BLOCK_SIZE * 3 / 2, 64 << 10}};
+
+	const i32 first = results.size();
+
+	BenchOptions options;
+	options.warmups = 1;
+	options.samples = config.quick ? 5 : 15;
+
+	ScratchPadAllocator longLived;
+
+	for (const Shape& shape : SHAPES)
+	{
+		const u64 requests = (config.quick ? 256ULL << 20 : 2048ULL << 20) / shape.bytes;
+
+		results.push_back(bench_run(bench_name("scratch/request_%s/fresh_allocator", shape.name), requests, [&] {
+			u64 rng = 1;
+			for (u64 i = 0; i < requests; ++i)
+			{
+				ScratchPadAllocator sa;
+				scratch_request(sa, shape.bytes, shape.maxSize, rng);
+			}
+		}, options));
+
+		results.push_back(bench_run(bench_name("scratch/request_%s/scope_rewind", shape.name), requests, [&] {
+			u64 rng = 1;
+			for (u64 i = 0; i < requests; ++i)
+			{
+				ScratchScope scope(longLived);
+				scratch_request(longLived, shape.bytes, shape.maxSize, rng);
+			}
+		}, options));
+	}
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+}
+
+static double resident_mb()
+{
+#if defined(__linux__)
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (!f)
+		return -1.0;
+	u64 size = 0;
+	u64 resident = 0;
+	if (fscanf(f, "%llu %llu", &size, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * 4096.0 / (1 << 20);
+#else
+	return -1.0;
+#endif
+}
+
+static void print_block_memory(const char* when)
+{
+	const BlockMemoryStats stats = block_memory_stats();
+	printf("%-28s mapped %4d blocks  idle %4d blocks  resident %8.1f MB\n", when, stats.mapped_blocks, stats.idle_blocks, resident_mb());
+}
+
+// A burst of live scratch allocators, each filling two blocks, then what stays behind once they are
+// gone and after a trim.
+void bench_scratch_spike(const BenchConfig& config)
+{
+	const i32 allocators = config.quick ? 16 : 64;
+
+	print_block_memory("before spike");
+	{
+		MallocAllocator ma;
+		Array<ScratchPadAllocator*> live(ma);
+		for (i32 i = 0; i < allocators; ++i)
+		{
+			ScratchPadAllocator* sa = new ScratchPadAllocator();
+			for (i32 a = 0; a < 4; ++a)
+			{
+				memset(sa->alloc(Block::BLOCK_SIZE / 3), 1, Block::BLOCK_SIZE / 3);
+			}
+			live.push_back(sa);
+		}
+		print_block_memory("during spike");
+
+		for (ScratchPadAllocator* sa : live)
+		{
+			delete sa;
+		}
+	}
+	print_block_memory("after spike");
+
+	block_memory_trim();
+	print_block_memory("after trim");
+}
@@ -0,0 +1,96 @@
+#include <atomic>
+#include <thread>
+
+#include "Bench.h"
+#include "ConcurrentSwissTable.h"
+#include "SnapshotSwissTable.h"
+
+// Reader threads do ops lookups each while one writer keeps publishing updates until they finish.
+// Returns wall time of the readers, the number of writes done meanwhile goes to writes.
+template<typename Table>
+static double run_readers(Table& table, u32 readers, u32 ops, u64 keys, u64& writes)
+{
+	std::atomic<bool> done{false};
+	std::thread writer([&] {
+		u64 rng = 42;
+		u64 count = 0;
+		while (!done.load(std::memory_order_relaxed))
+		{
+			table.insert_or_assign(bench_random(rng) % keys, count++);
+		}
+		writes = count;
+	});
+
+	auto reader = [&](u32 id) {
+		u64 rng = id * 7919 + 1;
+		u64 sum = 0;
+		for (u32 i = 0; i < ops; ++i)
+		{
+			u64 value;
+			sum += table.find(bench_random(rng) % keys, value) ? value : 1;
+		}
+		bench_sink(sum);
+	};
+
+	std::thread workers[256];
+	Timer t;
+	timer_init(&t);
+	timer_start(&t);
+	for (u32 i = 0; i < readers; ++i)
+	{
+		workers[i] = std::thread(reader, i);
+	}
+	for (u32 i = 0; i < readers; ++i)
+	{
+		workers[i].join();
+	}
+	const double ms = timer_elapsed_ms(&t);
+
+	done.store(true, std::memory_order_relaxed);
+	writer.join();
+	return ms;
+}
+
+void bench_snapshot(const BenchConfig& config, Array<BenchResult>& results)
+{
+	const u64 keys = config.quick ? (1 << 10) : (1 << 12);
+	const u32 ops = config.quick ? 200000 : 2000000;
+
+	u32 maxReaders = std::thread::hardware_concurrency();
+	maxReaders = maxReaders < 1 ? 1 : (maxReaders > 256 ? 256 : maxReaders);
+
+	for (u32 readers = 1;; readers *= 2)
+	{
+		readers = readers > maxReaders ? maxReaders : readers;
+
+		SnapshotSwissTable<u64, u64> snapshot;
+		ConcurrentSwissTable<u64, u64> sharded;
+		snapshot.update([&](SwissTable<u64, u64>& table) {
+			for (u64 i = 0; i < keys; ++i)
+			{
+				table.insert(i, i);
+			}
+		});
+		for (u64 i = 0; i < keys; ++i)
+		{
+			sharded.insert(i, i);
+		}
+
+		u64 snapshotWrites = 0;
+		u64 shardedWrites = 0;
+		const double snapshotMs = run_readers(snapshot, readers, ops, keys, snapshotWrites);
+		const double shardedMs = run_readers(sharded, readers, ops, keys, shardedWrites);
+		const double totalOps = (double)readers * ops;
+
+		printf("snapshot %3u readers: snapshot %8.2f Mreads/s (%llu publishes)  sharded rw lock %8.2f Mreads/s (%llu writes)\n",
+			readers, totalOps / (snapshotMs * 1000.0), snapshotWrites, totalOps / (shardedMs * 1000.0), shardedWrites);
+
+		double sample = snapshotMs;
+		results.push_back(bench_summarize(bench_name("snapshot/rcu/%u_readers", readers), (u64)totalOps, &sample, 1));
+		sample = shardedMs;
+		results.push_back(bench_summarize(bench_name("snapshot/sharded_rw/%u_readers", readers), (u64)totalOps, &sample, 1));
+
+		if (readers == maxReaders)
+			break;
+	}
+}
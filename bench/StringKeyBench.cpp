@@ -0,0 +1,97 @@
+#include <string>
+#include <unordered_map>
+
+#include "Bench.h"
+#include "SwissTable.h"
+
+// Key text lives in one buffer, lookups come in as views into it like parsed config paths would.
+struct StringKeys
+{
+	explicit StringKeys(Allocator& a)
+		: text(a)
+		, views(a)
+	{
+	}
+
+	Array<char> text;
+	Array<StringView> views;
+};
+
+static void make_string_keys(StringKeys& keys, u64 n)
+{
+	keys.text.resize((i32)(n * 32));
+	u64 pos = 0;
+	u64 rng = 7;
+	for (u64 i = 0; i < n; ++i)
+	{
+		char* p = &keys.text[(i32)pos];
+		const int len = snprintf(p, 32, "routes/svc%llu/%llx", i, bench_random(rng) & 0xFFFFFF);
+		keys.views.push_back(StringView(p, (u64)len));
+		pos += 32;
+	}
+}
+
+void bench_string_keys(const BenchConfig& config, Array<BenchResult>& results)
+{
+	static constexpr u64 SIZES[] = {1 << 10, 1 << 16};
+
+	MallocAllocator ma;
+
+	for (u64 n : SIZES)
+	{
+		if (n > config.max_elements)
+			break;
+
+		StringKeys keys(ma);
+		make_string_keys(keys, n);
+
+		BenchOptions options;
+		options.warmups = 1;
+		options.samples = config.quick ? 5 : 15;
+		const i32 first = results.size();
+
+		SwissTable<String, u64> swiss;
+		std::unordered_map<std::string, u64> stdMap;
+		for (u64 i = 0; i < n; ++i)
+		{
+			const StringView k = keys.views[(i32)i];
+			swiss.insert(k, i);
+			stdMap.emplace(std::string(k.data, k.length), i);
+		}
+
+		// Probes with the view directly, no owned key is built for the lookup.
+		results.push_back(bench_run(bench_name("swiss/string_find/%llu", n), n, [&] {
+			u64 sum = 0;
+			for (u64 i = 0; i < n; ++i)
+			{
+				sum += *swiss.find(keys.views[(i32)i]);
+			}
+			bench_sink(sum);
+		}, options));
+
+		// Without heterogeneous lookup the key has to be copied into a std::string first.
+		results.push_back(bench_run(bench_name("std/string_find/%llu", n), n, [&] {
+			u64 sum = 0;
+			for (u64 i = 0; i < n; ++i)
+			{
+				const StringView k = keys.views[(i32)i];
+				sum += stdMap.find(std::string(k.data, k.length))->second;
+			}
+			bench_sink(sum);
+		}, options));
+
+		results.push_back(bench_run(bench_name("swiss/string_insert/%llu", n), n, [&] {
+			SwissTable<String, u64> t;
+			for (u64 i = 0; i < n; ++i)
+			{
+				t.insert(keys.views[(i32)i], i);
+			}
+			bench_sink(t.size);
+		}, options));
+
+		for (i32 i = first; i < results.size(); ++i)
+		{
+			bench_print(results[i]);
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#include "Bench.h"
+#include "SwissTable.h"
+
+// Batched against scalar lookups and inserts on a table well beyond the LLC, requests of 256 keys.
+void bench_swiss_batch(const BenchConfig& config, Array<BenchResult>& results)
+{
+	constexpr u32 REQUEST = 256;
+	const u32 n = config.max_elements < (1 << 23) ? (u32)config.max_elements : (1 << 23);
+	const u32 lookups = 1 << 20;
+
+	BenchOptions options;
+	options.warmups = 1;
+	options.samples = config.quick ? 3 : 7;
+
+	MallocAllocator ma;
+	Array<u64> keys(ma);
+	Array<u64> values(ma);
+	Array<u64> queries(ma);
+	keys.resize(n);
+	values.resize(n);
+	queries.resize(lookups);
+
+	u64 rng = 42;
+	for (u32 i = 0; i < n; ++i)
+	{
+		keys[i] = bench_random(rng);
+		values[i] = i;
+	}
+	for (u32 i = 0; i < lookups; ++i)
+	{
+		queries[i] = keys[bench_random(rng) % n];
+	}
+
+	const i32 first = results.size();
+
+	SwissTable<u64, u64>* t = nullptr;
+	auto fresh = [&] {
+		delete t;
+		t = new SwissTable<u64, u64>();
+		t->reserve(n);
+	};
+
+	results.push_back(bench_run_with_setup(bench_name("swiss/insert_scalar/%u", n), n, fresh, [&] {
+		for (u32 i = 0; i < n; ++i)
+		{
+			t->insert(keys[i], values[i]);
+		}
+	}, options));
+
+	results.push_back(bench_run_with_setup(bench_name("swiss/insert_many/%u", n), n, fresh, [&] {
+		for (u32 i = 0; i < n; i += REQUEST)
+		{
+			u32 count = n - i < REQUEST ? n - i : REQUEST;
+			t->insert_many(&keys[i], &values[i], count);
+		}
+	}, options));
+
+	results.push_back(bench_run(bench_name("swiss/find_scalar/%u", n), lookups, [&] {
+		u64 sum = 0;
+		for (u32 i = 0; i < lookups; ++i)
+		{
+			sum += *t->find(queries[i]);
+		}
+		bench_sink(sum);
+	}, options));
+
+	results.push_back(bench_run(bench_name("swiss/find_many/%u", n), lookups, [&] {
+		u64* out[REQUEST];
+		u64 sum = 0;
+		for (u32 i = 0; i < lookups; i += REQUEST)
+		{
+			t->find_many(&queries[i], REQUEST, out);
+			for (u32 k = 0; k < REQUEST; ++k)
+			{
+				sum += *out[k];
+			}
+		}
+		bench_sink(sum);
+	}, options));
+
+	delete t;
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+}
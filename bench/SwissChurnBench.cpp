@@ -0,0 +1,64 @@
+#include "Bench.h"
+#include "SwissTable.h"
+
+// Key number i of the churn stream, live keys are always a window [first, first + n).
+static u64 churn_key(u64 i)
+{
+	u64 state = i;
+	return bench_random(state) & ~1ULL;
+}
+
+// Long running FIFO churn: every epoch replaces the whole live set once, then times lookups.
+// Latency has to stay flat as tombstones come and go.
+void bench_swiss_churn(const BenchConfig& config, Array<BenchResult>& results)
+{
+	const u64 n = config.quick ? (1 << 16) : (1 << 20);
+	const u32 epochs = config.quick ? 10 : 50;
+
+	BenchOptions options;
+	options.warmups = 0;
+	options.samples = 3;
+
+	SwissTable<u64, u64> t;
+	for (u64 i = 0; i < n; ++i)
+	{
+		t.insert(churn_key(i), i);
+	}
+
+	u64 first = 0;
+	u64 rng = 1;
+	for (u32 epoch = 0; epoch < epochs; ++epoch)
+	{
+		for (u64 i = 0; i < n; ++i)
+		{
+			t.erase(churn_key(first));
+			t.insert(churn_key(first + n), first + n);
+			++first;
+		}
+
+		BenchResult hit = bench_run(bench_name("swiss/churn_epoch_%02u/find_hit", epoch), n, [&] {
+			u64 sum = 0;
+			for (u64 i = 0; i < n; ++i)
+			{
+				const u64* v = t.find(churn_key(first + bench_random(rng) % n));
+				sum += v ? *v : 0;
+			}
+			bench_sink(sum);
+		}, options);
+
+		BenchResult miss = bench_run(bench_name("swiss/churn_epoch_%02u/find_miss", epoch), n, [&] {
+			u64 sum = 0;
+			for (u64 i = 0; i < n; ++i)
+			{
+				sum += t.find(churn_key(first + bench_random(rng) % n) | 1) != nullptr;
+			}
+			bench_sink(sum);
+		}, options);
+
+		printf("epoch %2u  hit %6.1f ns/op  miss %6.1f ns/op  size %u  deleted %u  capacity %u\n",
+			epoch, hit.ns_per_op, miss.ns_per_op, t.size, t.deleted, t.capacity);
+
+		results.push_back(hit);
+		results.push_back(miss);
+	}
+}
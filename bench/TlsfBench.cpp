@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "Bench.h"
+#include "SwissTable.h"
+#include "TlsfAllocator.h"
+
+static constexpr u32 LIVE_SLOTS = 1 << 15;
+
+struct TlsfSlot
+{
+	u8* block;
+	u32 size;
+};
+
+// Log uniform from 16 bytes to 64 KB, so every first level list sees traffic.
+static u32 random_size(u64& rng)
+{
+	const u64 r = bench_random(rng);
+	return (u32)((16ULL << (r % 13)) + (r >> 32) % (16ULL << (r % 13)));
+}
+
+// Fills every slot, then frees and reallocates random slots. The survivors of the fill fragment the
+// heap for the rest of the run. Each alloc and free after the fill is timed on its own, the fill
+// mostly measures page faults.
+static void fragmenting_run(const char* name, Allocator& allocator, u64 ops, Array<u32>& allocs, Array<u32>& frees)
+{
+	MallocAllocator ma;
+	Array<TlsfSlot> slots(ma);
+	slots.resize(LIVE_SLOTS);
+
+	Timer timer;
+	timer_init(&timer);
+
+	u64 rng = 7;
+	allocs.clear();
+	frees.clear();
+	for (u64 i = 0; i < ops; ++i)
+	{
+		TlsfSlot& slot = slots[(i32)(i < LIVE_SLOTS ? i : bench_random(rng) % LIVE_SLOTS)];
+		if (i < LIVE_SLOTS)
+		{
+			slot.size = random_size(rng);
+			slot.block = (u8*)allocator.alloc(slot.size);
+			slot.block[0] = 1;
+			continue;
+		}
+
+		timer_start(&timer);
+		allocator.free(slot.block, slot.size);
+		frees.push_back((u32)(timer_elapsed_ms(&timer) * 1000000.0));
+
+		slot.size = random_size(rng);
+		timer_start(&timer);
+		slot.block = (u8*)allocator.alloc(slot.size);
+		allocs.push_back((u32)(timer_elapsed_ms(&timer) * 1000000.0));
+		slot.block[0] = 1;
+	}
+
+	for (TlsfSlot& slot : slots)
+	{
+		allocator.free(slot.block, slot.size);
+	}
+
+	for (Array<u32>* latencies : {&allocs, &frees})
+	{
+		std::sort(latencies->begin(), latencies->end());
+		printf("%-8s %-5s p50 %5u  p99 %6u  p99.9 %7u  p99.99 %8u  max %9u ns\n", name, latencies == &allocs ? "alloc" : "free",
+			latency_percentile(*latencies, 0.5), latency_percentile(*latencies, 0.99), latency_percentile(*latencies, 0.999),
+			latency_percentile(*latencies, 0.9999), (*latencies)[latencies->size() - 1]);
+	}
+}
+
+// Alloc and free latency tails under fragmentation against malloc, then a hash table and its arrays
+// held to a budget with what the heap looks like afterwards.
+void bench_tlsf(const BenchConfig& config, Array<BenchResult>& results)
+{
+	const u64 ops = config.quick ? (1 << 20) : (1 << 23);
+
+	MallocAllocator ma;
+	Array<u32> allocs(ma);
+	Array<u32> frees(ma);
+	allocs.reserve((i32)ops);
+	frees.reserve((i32)ops);
+
+	fragmenting_run("malloc", ma, ops, allocs, frees);
+	{
+		TlsfAllocator tlsf;
+		fragmenting_run("tlsf", tlsf, ops, allocs, frees);
+		const TlsfHeapStats heap = tlsf.heap_stats();
+		printf("tlsf after run: %d regions, %u free blocks\n", heap.regions, heap.free_blocks);
+	}
+
+	const i32 first = results.size();
+	BenchOptions options;
+	options.warmups = 1;
+	options.samples = config.quick ? 5 : 11;
+
+	const u64 n = config.quick ? (1 << 18) : (1 << 21);
+	auto build = [n](Allocator& allocator) {
+		SwissTable<u64, u64> table(allocator);
+		Array<u64> keys(allocator);
+		u64 rng = 3;
+		for (u64 i = 0; i < n; ++i)
+		{
+			const u64 key = bench_random(rng);
+			table.insert(key, i);
+			keys.push_back(key);
+		}
+		bench_sink(table.size + keys.size());
+	};
+
+	results.push_back(bench_run(bench_name("tlsf/swiss_and_array/malloc/%llu", n), n, [&] { build(ma); }, options));
+	results.push_back(bench_run(bench_name("tlsf/swiss_and_array/tlsf/%llu", n), n, [&] {
+		TlsfAllocator tlsf;
+		build(tlsf);
+	}, options));
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+
+	TlsfConfig capped;
+	capped.budget = 256ULL << 20;
+	TlsfAllocator tlsf(capped);
+	build(tlsf);
+	u32 extra = 0;
+	while (tlsf.alloc(1 << 20))
+	{
+		++extra;
+	}
+
+	const AllocatorStats stats = tlsf.stats();
+	const TlsfHeapStats heap = tlsf.heap_stats();
+	printf("budget %llu MB: reserved %llu MB, live %llu MB, peak %llu MB after %u extra 1 MB blocks, %llu refused\n",
+		capped.budget >> 20, stats.bytes_reserved >> 20, stats.bytes_live >> 20, stats.bytes_peak >> 20, extra, heap.refused);
+	printf("heap: %d regions, %u free blocks, %llu KB free, largest %llu KB, fragmentation %.3f\n",
+		heap.regions, heap.free_blocks, heap.free_bytes >> 10, heap.largest_free >> 10, heap.fragmentation);
+}
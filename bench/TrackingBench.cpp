@@ -0,0 +1,100 @@
+#include <cstdio>
+
+#include "Bench.h"
+#include "HashMap.h"
+#include "ScratchAllocator.h"
+#include "SwissTable.h"
+#include "TrackingAllocator.h"
+
+// Many small arrays grown from empty, the allocation rate is as high as containers get.
+static void fill_arrays(Allocator& allocator, u64 n)
+{
+	constexpr u32 ARRAYS = 1024;
+	Array<Array<u32>*> arrays(allocator);
+	for (u32 a = 0; a < ARRAYS; ++a)
+	{
+		arrays.push_back(new Array<u32>(allocator));
+	}
+
+	for (u64 i = 0; i < n; ++i)
+	{
+		arrays[(i32)(i % ARRAYS)]->push_back((u32)i);
+	}
+
+	u64 sum = 0;
+	for (Array<u32>* a : arrays)
+	{
+		sum += a->back();
+		delete a;
+	}
+	bench_sink(sum);
+}
+
+static void print_stats(const char* name, const AllocatorStats& s)
+{
+	printf("%-10s allocs %9llu  frees %9llu  expands %7llu  requested %12llu  live %11llu  peak %11llu  reserved %11llu  wasted %10llu  copied %12llu\n",
+		name, s.allocs, s.frees, s.expands, s.bytes_requested, s.bytes_live, s.bytes_peak, s.bytes_reserved,
+		s.bytes_wasted, s.bytes_copied);
+}
+
+// What the tracking decorator costs on the allocation heavy path, then a per site summary of a small
+// mixed workload and the counters of the allocators underneath it.
+void bench_allocator_tracking(const BenchConfig& config, Array<BenchResult>& results)
+{
+	const u64 n = config.quick ? (1 << 20) : (1 << 24);
+	const i32 first = results.size();
+
+	BenchOptions options;
+	options.samples = config.quick ? 5 : 11;
+
+	MallocAllocator ma;
+	results.push_back(bench_run(bench_name("tracking/fill_arrays/malloc/%llu", n), n, [&] {
+		fill_arrays(ma, n);
+	}, options));
+
+	TrackingAllocator overhead(ma);
+	results.push_back(bench_run(bench_name("tracking/fill_arrays/tracked/%llu", n), n, [&] {
+		fill_arrays(overhead, n);
+	}, options));
+
+	for (i32 i = first; i < results.size(); ++i)
+	{
+		bench_print(results[i]);
+	}
+
+	MallocAllocator heap;
+	ScratchPadAllocator sa;
+	TrackingAllocator tracked(heap);
+	TrackingAllocator trackedScratch(sa);
+	{
+		SwissTable<u64, u64> table(tracked);
+		hashtable::Hashtable<u64> chained(tracked);
+		Array<u64> large(tracked);
+		Array<u64> temporaries(trackedScratch);
+
+		u64 rng = 1;
+		for (u32 i = 0; i < 100000; ++i)
+		{
+			const u64 key = bench_random(rng);
+			table.insert(key, i);
+			u64 value = i;
+			hashtable::insert(chained, key, value);
+			large.push_back(key);
+			temporaries.push_back(key);
+		}
+		fill_arrays(tracked, n / 16);
+
+		printf("\nheap sites, tables and arrays still alive\n");
+		tracked.dump();
+		printf("\nscratch sites\n");
+		trackedScratch.dump();
+	}
+
+	printf("\n");
+	print_stats("malloc", heap.stats());
+	print_stats("scratch", sa.stats());
+
+	const BlockMemoryStats blocks = block_memory_stats();
+	printf("blocks     mapped %d  idle %d  cache hits %llu  pool hits %llu  maps %llu  unmaps %llu\n",
+		blocks.mapped_blocks, blocks.idle_blocks, blocks.cache_hits, blocks.pool_hits, blocks.maps, blocks.unmaps);
+}
@@ -0,0 +1,70 @@
+#include "Bench.h"
+#include "wyhash.h"
+
+// Keys are laid out back to back in a buffer that fits in L2, so the numbers show the hash and
+// not the memory system.
+static constexpr u64 HASH_BUFFER_BYTES = 256 << 10;
+
+static void print_throughput(const BenchResult& r, u64 bytes)
+{
+	const double seconds = r.median_ms / 1000.0;
+	printf("%-24s %7.2f GB/s %8.2f Mhash/s\n", r.name, (double)bytes / seconds / 1e9, (double)r.ops / seconds / 1e6);
+}
+
+void bench_wyhash(const BenchConfig& config, Array<BenchResult>& results)
+{
+	static constexpr u64 KEY_LENGTHS[] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 4096};
+
+	MallocAllocator ma;
+	BenchOptions options;
+	options.warmups = 1;
+	options.samples = config.quick ? 5 : 15;
+
+	Array<u8> buffer(ma);
+	buffer.resize((i32)HASH_BUFFER_BYTES);
+	u64 rng = 1;
+	for (i32 i = 0; i < buffer.size(); ++i)
+	{
+		buffer[i] = (u8)bench_random(rng);
+	}
+
+	for (u64 len : KEY_LENGTHS)
+	{
+		const u64 count = HASH_BUFFER_BYTES / len;
+		const u8* keys = buffer.begin();
+
+		BenchResult r = bench_run(bench_name("wyhash/bytes/%llu", len), count, [&] {
+			u64 sum = 0;
+			for (u64 i = 0; i < count; ++i)
+			{
+				sum += wyhash::hash(keys + i * len, len);
+			}
+			bench_sink(sum);
+		}, options);
+
+		print_throughput(r, count * len);
+		results.push_back(r);
+	}
+
+	// 8 byte integer keys, one call per key against the batched form.
+	const u64 count = HASH_BUFFER_BYTES / sizeof(u64);
+	const u64* in = (const u64*)buffer.begin();
+	Array<u64> hashes(ma);
+	hashes.resize((i32)count);
+	u64* out = hashes.begin();
+
+	results.push_back(bench_run(bench_name("wyhash/u64/single"), count, [&] {
+		for (u64 i = 0; i < count; ++i)
+		{
+			out[i] = wyhash::hash(in[i]);
+		}
+		bench_sink(out[0]);
+	}, options));
+	print_throughput(results.back(), count * sizeof(u64));
+
+	results.push_back(bench_run(bench_name("wyhash/u64/hash_many"), count, [&] {
+		wyhash::hash_many(in, out, count);
+		bench_sink(out[0]);
+	}, options));
+	print_throughput(results.back(), count * sizeof(u64));
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+
+#include "Core.h"
+
+// What an allocator has been asked for and what it holds to serve it. Counters an allocator does
+// not keep stay zero.
+struct AllocatorStats
+{
+	u64 allocs = 0;
+	u64 frees = 0;
+	// try_expand calls that grew a block without the caller copying it.
+	u64 expands = 0;
+	// Sum of every size asked for, including growth through try_expand.
+	u64 bytes_requested = 0;
+	// Asked for and not freed yet, and the most that ever was at once.
+	u64 bytes_live = 0;
+	u64 bytes_peak = 0;
+	// Taken from the layer below: live bytes plus page rounding, padding and unused block tails.
+	u64 bytes_reserved = 0;
+	// Alignment padding and block tails left behind, never handed out.
+	u64 bytes_wasted = 0;
+	// Copied by containers into a new block because try_expand could not grow the old one.
+	u64 bytes_copied = 0;
+};
+
+// Counters for allocators shared between threads. Relaxed atomics, a snapshot taken while other
+// threads allocate is only consistent per field.
+struct SharedAllocatorStats
+{
+	// size is the total over count calls, for allocators that fold in counts kept per thread.
+	void on_alloc(u64 size, u64 count = 1)
+	{
+		allocs.fetch_add(count, std::memory_order_relaxed);
+		bytes_requested.fetch_add(size, std::memory_order_relaxed);
+		add_live(size);
+	}
+
+	void on_free(u64 size, u64 count = 1)
+	{
+		frees.fetch_add(count, std::memory_order_relaxed);
+		bytes_live.fetch_sub(size, std::memory_order_relaxed);
+	}
+
+	void on_expand(u64 size, u64 newSize)
+	{
+		expands.fetch_add(1, std::memory_order_relaxed);
+		bytes_requested.fetch_add(newSize - size, std::memory_order_relaxed);
+		add_live(newSize - size);
+	}
+
+	void on_copy(u64 bytes)
+	{
+		bytes_copied.fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	AllocatorStats load() const
+	{
+		AllocatorStats stats;
+		stats.allocs = allocs.load(std::memory_order_relaxed);
+		stats.frees = frees.load(std::memory_order_relaxed);
+		stats.expands = expands.load(std::memory_order_relaxed);
+		stats.bytes_requested = bytes_requested.load(std::memory_order_relaxed);
+		stats.bytes_live = bytes_live.load(std::memory_order_relaxed);
+		stats.bytes_peak = bytes_peak.load(std::memory_order_relaxed);
+		stats.bytes_reserved = stats.bytes_live;
+		stats.bytes_copied = bytes_copied.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	std::atomic<u64> allocs{0};
+	std::atomic<u64> frees{0};
+	std::atomic<u64> expands{0};
+	std::atomic<u64> bytes_requested{0};
+	std::atomic<u64> bytes_live{0};
+	std::atomic<u64> bytes_peak{0};
+	std::atomic<u64> bytes_copied{0};
+
+private:
+	// The peak is only written while it rises, which stops happening once a workload is warm.
+	void add_live(u64 size)
+	{
+		const u64 live = bytes_live.fetch_add(size, std::memory_order_relaxed) + size;
+		u64 peak = bytes_peak.load(std::memory_order_relaxed);
+		while (live > peak && !bytes_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		{
+		}
+	}
+};
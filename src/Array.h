@@ -3,6 +3,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <new>
+#include <type_traits>
+#include <utility>
+
+#include "AllocatorStats.h"
 
 #define interface struct
 
@@ -13,8 +17,17 @@ interface Allocator
 {
 	virtual ~Allocator() = default;
 
-	virtual void* alloc(i32 size) = 0;
-	virtual void free(void* block, i32 size) = 0;
+	virtual void* alloc(u64 size) = 0;
+	virtual void free(void* block, u64 size) = 0;
+
+	// Grows block to newSize without the caller copying it. Returns the block, which may have moved
+	// with its contents, or nullptr when that is not possible and block is left as it was.
+	virtual void* try_expand(void* /*block*/, u64 /*size*/, u64 /*newSize*/) { return nullptr; }
+
+	// Containers report here when try_expand failed and they copied bytes into their new block.
+	virtual void note_copy(void* /*block*/, u64 /*bytes*/) {}
+
+	virtual AllocatorStats stats() const { return AllocatorStats(); }
 };
 
 class MallocAllocator : public Allocator
@@ -23,17 +36,46 @@ public:
 	MallocAllocator() = default;
 	~MallocAllocator() override = default;
 
-	void* alloc(i32 size) override
+	void* alloc(u64 size) override
 	{
+		m_stats.on_alloc(size);
 		return ::malloc(size);
 	}
 
-	void free(void* block, i32 size) override
+	void free(void* block, u64 size) override
 	{
+		if (block)
+			m_stats.on_free(size);
 		return ::free(block);
 	}
+
+	void note_copy(void* /*block*/, u64 bytes) override
+	{
+		m_stats.on_copy(bytes);
+	}
+
+	// Reserved is what was asked for, malloc's own headers and rounding are not visible here.
+	AllocatorStats stats() const override
+	{
+		return m_stats.load();
+	}
+
+private:
+	SharedAllocatorStats m_stats;
 };
 
+// Process wide heap allocator for containers that are not given one.
+inline Allocator& default_allocator()
+{
+	static MallocAllocator allocator;
+	return allocator;
+}
+
+// Types that can move to a new address by memcpy, with the old bytes simply dropped. Containers
+// growing with memcpy or try_expand rely on it. Trivially copyable types are, containers that hold
+// no pointers into themselves opt in next to their definition.
+template<typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
 
 template<typename T>
 class Array
@@ -42,16 +84,35 @@ public:
 	explicit Array(Allocator& allocator);
 	~Array();
 
-	void push_back(T val);
+	// Deep copy on the same allocator.
+	Array(const Array& r);
+	// Takes r's buffer and allocator, r is left empty.
+	Array(Array&& r);
+
+	Array& operator=(const Array& r);
+	// Takes r's buffer when both use the same allocator, otherwise moves the elements over.
+	Array& operator=(Array&& r);
+
+	void push_back(const T& val);
+	void push_back(T&& val);
+	template<typename... Args>
+	T& emplace_back(Args&&... args);
 	T& back();
 
 	void* push_back_uninit();
 
 	void resize(i32 new_size);
+	// Sets the size without constructing anything, the caller fills the new elements.
+	void resize_uninit(i32 new_size);
 	void reserve(i32 new_capacity);
+	// Drops unused capacity, an empty array gives its memory back.
+	void shrink_to_fit();
 
 	void clear();
 
+	// Exchanges contents, both arrays have to use the same allocator.
+	void swap(Array& r);
+
 	T& operator[](i32 i);
 	const T& operator[](i32 i) const;
 
@@ -60,9 +121,13 @@ public:
 
 	T* begin();
 	T* end();
+	const T* begin() const;
+	const T* end() const;
 
 private:
 	void grow();
+	// Moves the elements into new_data, which holds at least m_size, and frees the old buffer.
+	void relocate(T* new_data);
 private:
 	Allocator& m_allocator;
 
@@ -96,13 +161,111 @@ Array<T>::~Array()
 }
 
 template <typename T>
-void Array<T>::push_back(T val)
+Array<T>::Array(const Array& r)
+	: m_allocator(r.m_allocator)
+{
+	*this = r;
+}
+
+template <typename T>
+Array<T>::Array(Array&& r)
+	: m_allocator(r.m_allocator)
+	, m_data(r.m_data)
+	, m_size(r.m_size)
+	, m_capacity(r.m_capacity)
+{
+	r.m_data = nullptr;
+	r.m_size = 0;
+	r.m_capacity = 0;
+}
+
+template <typename T>
+Array<T>& Array<T>::operator=(const Array& r)
+{
+	if (this == &r)
+		return *this;
+
+	clear();
+	reserve(r.m_size);
+
+	if (std::is_trivially_copyable<T>::value)
+	{
+		if (r.m_size > 0)
+			memcpy((void*)m_data, r.m_data, sizeof(T) * r.m_size);
+	}
+	else
+	{
+		for (i32 i = 0; i < r.m_size; ++i)
+		{
+			new (&m_data[i]) T(r.m_data[i]);
+		}
+	}
+
+	m_size = r.m_size;
+	return *this;
+}
+
+template <typename T>
+Array<T>& Array<T>::operator=(Array&& r)
+{
+	if (this == &r)
+		return *this;
+
+	if (&m_allocator == &r.m_allocator)
+	{
+		clear();
+		if (m_data)
+		{
+			m_allocator.free(m_data, sizeof(T) * m_capacity);
+		}
+
+		m_data = r.m_data;
+		m_size = r.m_size;
+		m_capacity = r.m_capacity;
+		r.m_data = nullptr;
+		r.m_size = 0;
+		r.m_capacity = 0;
+		return *this;
+	}
+
+	clear();
+	reserve(r.m_size);
+	for (i32 i = 0; i < r.m_size; ++i)
+	{
+		new (&m_data[i]) T(std::move(r.m_data[i]));
+	}
+	m_size = r.m_size;
+	r.clear();
+	return *this;
+}
+
+template <typename T>
+void Array<T>::push_back(const T& val)
+{
+	emplace_back(val);
+}
+
+template <typename T>
+void Array<T>::push_back(T&& val)
+{
+	emplace_back(std::move(val));
+}
+
+template <typename T>
+template <typename... Args>
+T& Array<T>::emplace_back(Args&&... args)
 {
 	if (m_size == m_capacity)
+	{
+		// args may point into the buffer that growth frees, build the element first.
+		T val(std::forward<Args>(args)...);
 		grow();
+		new (&m_data[m_size]) T(std::move(val));
+		return m_data[m_size++];
+	}
 
-	new (&m_data[m_size]) T(val);
-	++m_size;
+	new (&m_data[m_size]) T(std::forward<Args>(args)...);
+	return m_data[m_size++];
 }
 
 template <typename T>
@@ -146,28 +309,86 @@ void Array<T>::resize(i32 new_size)
 	m_size = new_size;
 }
 
+template <typename T>
+void Array<T>::resize_uninit(i32 new_size)
+{
+	if (new_size > m_capacity)
+	{
+		reserve(new_size);
+	}
+
+	for (i32 i = new_size; i < m_size; ++i)
+	{
+		m_data[i].~T();
+	}
+
+	m_size = new_size;
+}
+
+// Asks the allocator to grow the block in place first, copying is the fallback. try_expand may move
+// the bytes, so it is only asked for trivially relocatable types.
 template <typename T>
 void Array<T>::reserve(i32 new_capacity)
 {
 	if (new_capacity > m_capacity)
 	{
-		T* new_data = (T*)m_allocator.alloc(sizeof(T) * new_capacity);
-
-		if (m_size > 0)
+		T* new_data = nullptr;
+		if (m_data && is_trivially_relocatable<T>::value)
 		{
-			memcpy(new_data, m_data, sizeof(T) * m_size);
+			new_data = (T*)m_allocator.try_expand(m_data, sizeof(T) * m_capacity, sizeof(T) * new_capacity);
 		}
 
-		if(m_data)
+		if (!new_data)
 		{
-			m_allocator.free(m_data, sizeof(T) * m_capacity);
+			relocate((T*)m_allocator.alloc(sizeof(T) * new_capacity));
+		}
+		else
+		{
+			m_data = new_data;
 		}
 
-		m_data = new_data;
 		m_capacity = new_capacity;
 	}
 }
 
+template <typename T>
+void Array<T>::shrink_to_fit()
+{
+	if (m_size == m_capacity)
+		return;
+
+	relocate(m_size > 0 ? (T*)m_allocator.alloc(sizeof(T) * m_size) : nullptr);
+	m_capacity = m_size;
+}
+
+template <typename T>
+void Array<T>::relocate(T* new_data)
+{
+	if (m_size > 0)
+	{
+		if (is_trivially_relocatable<T>::value)
+		{
+			memcpy((void*)new_data, m_data, sizeof(T) * m_size);
+			m_allocator.note_copy(new_data, sizeof(T) * m_size);
+		}
+		else
+		{
+			for (i32 i = 0; i < m_size; ++i)
+			{
+				new (&new_data[i]) T(std::move(m_data[i]));
+				m_data[i].~T();
+			}
+		}
+	}
+
+	if (m_data)
+	{
+		m_allocator.free(m_data, sizeof(T) * m_capacity);
+	}
+
+	m_data = new_data;
+}
+
 template <typename T>
 void Array<T>::clear()
 {
@@ -179,6 +400,22 @@ void Array<T>::clear()
 	m_size = 0;
 }
 
+template <typename T>
+void Array<T>::swap(Array& r)
+{
+	T* data = m_data;
+	i32 size = m_size;
+	i32 capacity = m_capacity;
+
+	m_data = r.m_data;
+	m_size = r.m_size;
+	m_capacity = r.m_capacity;
+
+	r.m_data = data;
+	r.m_size = size;
+	r.m_capacity = capacity;
+}
+
 template <typename T>
 T& Array<T>::operator[](i32 i)
 {
@@ -204,20 +441,23 @@ T* Array<T>::end()
 }
 
 template <typename T>
-void Array<T>::grow()
+const T* Array<T>::begin() const
 {
-	i32 new_capacity = m_capacity < 1 ? 1 : (m_capacity * 2);
-	
-	T* new_data = (T*)m_allocator.alloc(sizeof(T) * new_capacity);
+	return m_data;
+}
 
-	if (m_size > 0)
-	{
-		memcpy(new_data, m_data, sizeof(T) * m_size);
-	}
-	if(m_data)
-	{
-		m_allocator.free(m_data, sizeof(T) * m_capacity);
-	}
-	m_data = new_data;
-	m_capacity = new_capacity;
+template <typename T>
+const T* Array<T>::end() const
+{
+	return m_data + m_size;
+}
+
+template <typename T>
+void Array<T>::grow()
+{
+	reserve(m_capacity < 1 ? 1 : (m_capacity * 2));
 }
+
+// Holds only a pointer to its heap buffer.
+template<typename T>
+struct is_trivially_relocatable<Array<T>> : std::true_type {};
@@ -0,0 +1,54 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+
+static double percentile(const double* sorted, i32 count, double p)
+{
+	i32 rank = (i32)(p * count + 0.999999);
+	rank = rank < 1 ? 1 : (rank > count ? count : rank);
+	return sorted[rank - 1];
+}
+
+BenchResult bench_summarize(const char* name, u64 ops, double* samples_ms, i32 count)
+{
+	BenchResult result = {};
+	result.name = name;
+	result.ops = ops;
+	result.samples = count;
+
+	if (count == 0)
+		return result;
+
+	std::sort(samples_ms, samples_ms + count);
+
+	result.min_ms = samples_ms[0];
+	result.median_ms = count % 2 ? samples_ms[count / 2] : (samples_ms[count / 2 - 1] + samples_ms[count / 2]) * 0.5;
+	result.p90_ms = percentile(samples_ms, count, 0.90);
+	result.p99_ms = percentile(samples_ms, count, 0.99);
+	result.ns_per_op = ops ? result.median_ms * 1000000.0 / ops : 0.0;
+
+	return result;
+}
+
+void bench_print(const BenchResult& r)
+{
+	printf("%-40s min %10.3f ms  median %10.3f ms  p90 %10.3f ms  p99 %10.3f ms  %10.2f ns/op\n",
+		r.name, r.min_ms, r.median_ms, r.p90_ms, r.p99_ms, r.ns_per_op);
+}
+
+void bench_write_json(FILE* file, const BenchResult* results, i32 count)
+{
+	fprintf(file, "{\n  \"timer\": \"%s\",\n  \"results\": [\n", timer_backend());
+
+	for (i32 i = 0; i < count; ++i)
+	{
+		const BenchResult& r = results[i];
+		fprintf(file,
+			"    {\"name\": \"%s\", \"ops\": %llu, \"samples\": %d, \"min_ms\": %.6f, \"median_ms\": %.6f, "
+			"\"p90_ms\": %.6f, \"p99_ms\": %.6f, \"ns_per_op\": %.4f}%s\n",
+			r.name, r.ops, r.samples, r.min_ms, r.median_ms, r.p90_ms, r.p99_ms, r.ns_per_op,
+			i + 1 < count ? "," : "");
+	}
+
+	fputs("  ]\n}\n", file);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdio>
+
+#include "Array.h"
+#include "Core.h"
+#include "Timer.h"
+
+struct BenchOptions
+{
+	i32 warmups = 3;
+	i32 samples = 25;
+};
+
+struct BenchResult
+{
+	const char* name;
+	u64 ops; // operations per sample
+	i32 samples;
+	double min_ms;
+	double median_ms;
+	double p90_ms;
+	double p99_ms;
+	double ns_per_op; // from the median sample
+};
+
+// Sorts samples_ms in place.
+BenchResult bench_summarize(const char* name, u64 ops, double* samples_ms, i32 count);
+
+void bench_print(const BenchResult& result);
+
+void bench_write_json(FILE* file, const BenchResult* results, i32 count);
+
+// Calls fn warmups + samples times, every call is one timed sample of ops operations.
+// setup runs untimed before every call.
+template<typename Setup, typename Fn>
+BenchResult bench_run_with_setup(const char* name,
+	u64 ops,
+	Setup&& setup,
+	Fn&& fn,
+	const BenchOptions& options = BenchOptions())
+{
+	MallocAllocator ma;
+	Array<double> samples(ma);
+	samples.resize(options.samples);
+
+	for (i32 i = 0; i < options.warmups; ++i)
+	{
+		setup();
+		fn();
+	}
+
+	Timer t;
+	timer_init(&t);
+
+	for (i32 i = 0; i < options.samples; ++i)
+	{
+		setup();
+		timer_start(&t);
+		fn();
+		samples[i] = timer_elapsed_ms(&t);
+	}
+
+	return bench_summarize(name, ops, samples.begin(), samples.size());
+}
+
+template<typename Fn>
+BenchResult bench_run(const char* name, u64 ops, Fn&& fn, const BenchOptions& options = BenchOptions())
+{
+	return bench_run_with_setup(name, ops, [] {}, fn, options);
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "SwissTable.h"
+
+inline void cpu_relax()
+{
+#if SWISS_SSE2
+	_mm_pause();
+#endif
+}
+
+// Reader/writer spin lock in one word. A writer claims the top bit, which turns new readers away,
+// then waits for the readers already inside to leave. Backs off to yield so oversubscribed
+// threads do not burn a whole time slice.
+struct RwSpinLock
+{
+	static constexpr u32 WRITER = 1u << 31;
+
+	void lock_shared()
+	{
+		for (u32 spins = 0;; ++spins)
+		{
+			u32 s = state.load(std::memory_order_relaxed);
+			if (!(s & WRITER) && state.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+				return;
+			backoff(spins);
+		}
+	}
+
+	void unlock_shared() { state.fetch_sub(1, std::memory_order_release); }
+
+	void lock()
+	{
+		for (u32 spins = 0;; ++spins)
+		{
+			u32 s = state.load(std::memory_order_relaxed);
+			if (!(s & WRITER) && state.compare_exchange_weak(s, s | WRITER, std::memory_order_acquire))
+				break;
+			backoff(spins);
+		}
+
+		for (u32 spins = 0; state.load(std::memory_order_acquire) != WRITER; ++spins)
+		{
+			backoff(spins);
+		}
+	}
+
+	void unlock() { state.store(0, std::memory_order_release); }
+
+	static void backoff(u32 spins)
+	{
+		if (spins < 64)
+			cpu_relax();
+		else
+			std::this_thread::yield();
+	}
+
+	std::atomic<u32> state{0};
+};
+
+// SwissTable split into a power of 2 number of shards, picked by the top bits of the key hash.
+// Each shard has its own reader/writer lock on its own cache line. Values are copied out,
+// pointers into a shard would not survive a concurrent rehash.
+template<typename K, typename V, typename Hasher = WyHash, typename Eq = KeyEqual>
+class ConcurrentSwissTable
+{
+	using Lookup = typename SwissKeyTraits<K>::Lookup;
+
+	struct alignas(64) Shard
+	{
+		explicit Shard(Allocator& allocator)
+			: table(allocator)
+		{
+		}
+
+		RwSpinLock lock;
+		SwissTable<K, V, Hasher, Eq> table;
+	};
+
+public:
+	explicit ConcurrentSwissTable(u32 shardCount = 64);
+	ConcurrentSwissTable(Allocator& allocator, u32 shardCount = 64);
+	~ConcurrentSwissTable();
+
+	ConcurrentSwissTable(const ConcurrentSwissTable&) = delete;
+	ConcurrentSwissTable& operator=(const ConcurrentSwissTable&) = delete;
+
+	// Copies the value into out, returns false when the key is missing.
+	bool find(const Lookup& key, V& out) const;
+
+	// Returns false when the key was already present, the stored value is left as it is.
+	bool insert(const Lookup& key, const V& value);
+
+	void insert_or_assign(const Lookup& key, const V& value);
+
+	bool erase(const Lookup& key);
+
+	// Calls fn(V& value, bool inserted) under the shard's write lock, a missing key is inserted
+	// value initialized first. Read-modify-write without a window between find and insert.
+	template<typename Fn>
+	void upsert(const Lookup& key, Fn&& fn);
+
+	// Sum over all shards, only exact while no writer is active.
+	u32 size() const;
+
+	u32 shard_count() const { return m_shardCount; }
+
+private:
+	Shard& shard_for(const Lookup& key) const;
+
+private:
+	Allocator& m_allocator;
+	u8* m_memory;
+	Shard* m_shards;
+	u32 m_shardCount;
+	u32 m_shardShift;
+};
+
+template <typename K, typename V, typename Hasher, typename Eq>
+ConcurrentSwissTable<K, V, Hasher, Eq>::ConcurrentSwissTable(u32 shardCount)
+	: ConcurrentSwissTable(default_allocator(), shardCount)
+{
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+ConcurrentSwissTable<K, V, Hasher, Eq>::ConcurrentSwissTable(Allocator& allocator, u32 shardCount)
+	: m_allocator(allocator)
+{
+	m_shardCount = (u32)power_of_2(shardCount);
+	m_shardShift = 64;
+	for (u32 n = m_shardCount; n > 1; n >>= 1)
+	{
+		--m_shardShift;
+	}
+
+	// Room to align the shard array to a cache line inside the allocation.
+	m_memory = (u8*)m_allocator.alloc(sizeof(Shard) * m_shardCount + 64);
+	m_shards = (Shard*)(((u64)m_memory + 63) & ~63ULL);
+	for (u32 i = 0; i < m_shardCount; ++i)
+	{
+		new (&m_shards[i]) Shard(m_allocator);
+	}
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+ConcurrentSwissTable<K, V, Hasher, Eq>::~ConcurrentSwissTable()
+{
+	for (u32 i = 0; i < m_shardCount; ++i)
+	{
+		m_shards[i].~Shard();
+	}
+
+	m_allocator.free(m_memory, sizeof(Shard) * m_shardCount + 64);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+typename ConcurrentSwissTable<K, V, Hasher, Eq>::Shard& ConcurrentSwissTable<K, V, Hasher, Eq>::shard_for(const Lookup& key) const
+{
+	return m_shards[m_shardShift < 64 ? Hasher{}(key) >> m_shardShift : 0];
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+bool ConcurrentSwissTable<K, V, Hasher, Eq>::find(const Lookup& key, V& out) const
+{
+	Shard& shard = shard_for(key);
+	shard.lock.lock_shared();
+
+	const V* value = static_cast<const SwissTable<K, V, Hasher, Eq>&>(shard.table).find(key);
+	if (value)
+		out = *value;
+
+	shard.lock.unlock_shared();
+	return value != nullptr;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+bool ConcurrentSwissTable<K, V, Hasher, Eq>::insert(const Lookup& key, const V& value)
+{
+	Shard& shard = shard_for(key);
+	shard.lock.lock();
+
+	V* slot = shard.table.insert_uninit(key);
+	if (slot)
+		new (slot) V(value);
+
+	shard.lock.unlock();
+	return slot != nullptr;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+void ConcurrentSwissTable<K, V, Hasher, Eq>::insert_or_assign(const Lookup& key, const V& value)
+{
+	Shard& shard = shard_for(key);
+	shard.lock.lock();
+	shard.table.insert_or_assign(key, value);
+	shard.lock.unlock();
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+bool ConcurrentSwissTable<K, V, Hasher, Eq>::erase(const Lookup& key)
+{
+	Shard& shard = shard_for(key);
+	shard.lock.lock();
+	bool erased = shard.table.erase(key);
+	shard.lock.unlock();
+	return erased;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+template <typename Fn>
+void ConcurrentSwissTable<K, V, Hasher, Eq>::upsert(const Lookup& key, Fn&& fn)
+{
+	Shard& shard = shard_for(key);
+	shard.lock.lock();
+
+	V* value = shard.table.insert_uninit(key);
+	bool inserted = value != nullptr;
+	if (inserted)
+		new (value) V();
+	else
+		value = shard.table.find(key);
+
+	fn(*value, inserted);
+
+	shard.lock.unlock();
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 ConcurrentSwissTable<K, V, Hasher, Eq>::size() const
+{
+	u32 total = 0;
+	for (u32 i = 0; i < m_shardCount; ++i)
+	{
+		m_shards[i].lock.lock_shared();
+		total += m_shards[i].table.size;
+		m_shards[i].lock.unlock_shared();
+	}
+	return total;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdio>
+#include <cstdlib>
+
 using u8 = unsigned char;
 using u16 = unsigned short;
 using u32 = unsigned int;
@@ -7,4 +10,21 @@ using u64 = unsigned long long;
 using i8 = char;
 using i16 = short;
 using i32 = int;
-using i64 = long long;
\ No newline at end of file
+using i64 = long long;
+
+// For failures the caller is told about, a nullptr return and the like. Stops in debug builds,
+// release builds go on.
+#if defined(NDEBUG)
+#define LIME_DEBUG_BREAK() ((void)0)
+#elif defined(_MSC_VER)
+#define LIME_DEBUG_BREAK() __debugbreak()
+#else
+#define LIME_DEBUG_BREAK() __builtin_trap()
+#endif
+
+// For states where going on would corrupt memory.
+[[noreturn]] inline void lime_fatal(const char* message)
+{
+	fprintf(stderr, "%s\n", message);
+	abort();
+}
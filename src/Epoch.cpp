@@ -0,0 +1,80 @@
+#include "Epoch.h"
+
+#include <atomic>
+
+// Epoch 0 marks a free or idle slot, counting starts at 1.
+struct alignas(64) EpochSlot
+{
+	std::atomic<u64> pinned{0};
+	std::atomic<bool> used{false};
+};
+
+static EpochSlot s_slots[EPOCH_MAX_THREADS];
+static std::atomic<u64> s_epoch{1};
+
+struct EpochThread
+{
+	u32 slot = claim();
+	u32 depth = 0;
+
+	~EpochThread()
+	{
+		s_slots[slot].pinned.store(0, std::memory_order_release);
+		s_slots[slot].used.store(false, std::memory_order_release);
+	}
+
+	static u32 claim()
+	{
+		for (u32 i = 0; i < EPOCH_MAX_THREADS; ++i)
+		{
+			bool expected = false;
+			if (!s_slots[i].used.load(std::memory_order_relaxed) && s_slots[i].used.compare_exchange_strong(expected, true))
+				return i;
+		}
+
+		// A shared slot would let one thread's unpin drop the other's, and a version still being read
+		// could be freed.
+		lime_fatal("More than EPOCH_MAX_THREADS threads reading epoch protected memory");
+	}
+};
+
+static thread_local EpochThread t_epoch;
+
+EpochGuard::EpochGuard()
+{
+	EpochThread& thread = t_epoch;
+	if (thread.depth++ == 0)
+	{
+		s_slots[thread.slot].pinned.store(s_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		// Pairs with the fence in epoch_advance, either the writer sees this pin or this reader
+		// sees the newly published pointer.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+EpochGuard::~EpochGuard()
+{
+	EpochThread& thread = t_epoch;
+	if (--thread.depth == 0)
+	{
+		s_slots[thread.slot].pinned.store(0, std::memory_order_release);
+	}
+}
+
+u64 epoch_advance()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	return s_epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+u64 epoch_safe()
+{
+	u64 oldest = ~0ULL;
+	for (u32 i = 0; i < EPOCH_MAX_THREADS; ++i)
+	{
+		u64 pinned = s_slots[i].pinned.load(std::memory_order_acquire);
+		if (pinned && pinned < oldest)
+			oldest = pinned;
+	}
+	return oldest;
+}
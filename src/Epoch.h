@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Core.h"
+
+// Epoch based reclamation, one domain for the whole process. A reader pins the current epoch for
+// the length of a read, memory a writer retires in epoch e may be freed once every pinned reader
+// is past e. Readers never block and never write shared state other than their own slot.
+
+// Live threads that have taken an EpochGuard, a slot is held until the thread exits. One more aborts
+// the process.
+static constexpr u32 EPOCH_MAX_THREADS = 256;
+
+// Pins the calling thread for its lifetime. Nests, only the outermost guard pins.
+struct EpochGuard
+{
+	EpochGuard();
+	~EpochGuard();
+
+	EpochGuard(const EpochGuard&) = delete;
+	EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+// Call after unpublishing memory, returns the epoch to retire it in.
+u64 epoch_advance();
+
+// Oldest epoch still pinned by a reader, memory retired in an epoch below this is unreachable.
+u64 epoch_safe();
@@ -1,16 +1,26 @@
 #pragma once
 
-#include <vector>
+#include <cstring>
+#include <new>
 
-using u32 = unsigned int;
-using u64 = unsigned long long;
-
-template<typename T>
-using Array = std::vector<T>;
+#include "Array.h"
+#include "Core.h"
 
 namespace hashtable
 {
 
+constexpr u32 NULL_ENTRY = u32(-1);
+constexpr float MAX_LOAD_FACTOR = 0.7f;
+// Power of 2, rehash derives the starting shift from it.
+constexpr u32 MIN_BUCKETS = 16;
+static_assert(MIN_BUCKETS >= 2 && (MIN_BUCKETS & (MIN_BUCKETS - 1)) == 0, "MIN_BUCKETS has to be a power of 2");
+// Old buckets relinked per insert or erase during an incremental rehash. Growth doubles at 70% load,
+// so the old array is drained well before the next growth is due.
+constexpr u32 MIGRATE_BUCKETS = 4;
+
+// Chained table over one dense entry array, bucket heads and next links are indices into it.
+// Keys are not checked for duplicates, a later insert shadows an earlier one until it is erased.
+// Values are relocated with memcpy.
 template<typename T>
 struct Hashtable
 {
@@ -21,58 +31,98 @@ struct Hashtable
 		T value;
 	};
 
-	// Entry defined in DDF like
+	explicit Hashtable(Allocator& allocator = default_allocator())
+		: hash(allocator)
+		, data(allocator)
+		, oldHash(allocator)
+	{
+	}
 
-	// KeyType Key (u64 hash or similar)
-	// u32 Next;
-	// EntryType Value; <- Value to store in the hash
-	// Need to implement modulo for key signature u32 keymod(KeyType, u32 modulo);
+	Hashtable(const Hashtable&) = delete;
+	Hashtable& operator=(const Hashtable&) = delete;
 
 	Array<u32> hash;
 	Array<Entry> data;
+	// 64 - log2(bucket count), buckets are picked by the top bits of a multiplicative hash.
+	u32 shift = 64;
+
+	// Growth relinks MIGRATE_BUCKETS old buckets per insert or erase instead of all entries at once.
+	// Until oldHash is drained, its buckets from migrated on still own their chains.
+	bool incremental = false;
+	Array<u32> oldHash;
+	u32 oldShift = 64;
+	u32 migrated = 0;
 };
 
-constexpr u32 NULL_ENTRY = u32(-1);
-
 struct HashFind
 {
-	u32 hashIndex;
 	u32 dataPrev;
 	u32 dataIndex;
 };
 
-template<typename Entry>
-bool isFull(const Hashtable<Entry>& h);
+template<typename T>
+bool isFull(const Hashtable<T>& h);
+
+template<typename T>
+u32 addEntry(Hashtable<T>& h, u64 key);
 
-template<typename Entry, typename Key>
-u32 addEntry(Hashtable<Entry>& h, Key key);
+template<typename T, typename Value>
+void insert(Hashtable<T>& h, u64 key, Value&& value);
 
-template<typename Entry, typename Key, typename Value>
-void insert(Hashtable<Entry>& h, Key key, Value&& value);
+template<typename T>
+void erase(Hashtable<T>& h, u64 key);
 
-template<typename Entry, typename Key>
-void erase(Hashtable<Entry>& h, Key key);
+template<typename T>
+void rehash(Hashtable<T>& h, u32 newSize);
 
-template<typename Entry>
-void rehash(Hashtable<Entry>& h, u32 newSize);
+template<typename T>
+void grow(Hashtable<T>& h);
 
-template<typename Entry>
-void grow(Hashtable<Entry>& h);
+template<typename T>
+void migrate(Hashtable<T>& h, u32 buckets);
+
+// Replaces the contents with keys[i] -> values[i]. One sequential copy into data, sized once,
+// then a single pass links every entry into its bucket. Later duplicates shadow earlier ones.
+template<typename T>
+void build(Hashtable<T>& h, const u64* keys, const T* values, u32 n);
+
+// Fibonacci hashing, one multiply and a shift instead of a division by the bucket count.
+template<typename T>
+u32 bucketIndex(const Hashtable<T>& h, u64 key)
+{
+	return (u32)((key * 0x9E3779B97F4A7C15ULL) >> h.shift);
+}
+
+// Head of the chain key belongs to, in the old bucket array while its bucket there is not migrated.
+template<typename T>
+const u32* bucketHead(const Hashtable<T>& h, u64 key)
+{
+	if (h.oldHash.size() != 0)
+	{
+		const u32 b = (u32)((key * 0x9E3779B97F4A7C15ULL) >> h.oldShift);
+		if (b >= h.migrated)
+			return &h.oldHash[(i32)b];
+	}
+	return &h.hash[(i32)bucketIndex(h, key)];
+}
 
+template<typename T>
+u32* bucketHead(Hashtable<T>& h, u64 key)
+{
+	return const_cast<u32*>(bucketHead(static_cast<const Hashtable<T>&>(h), key));
+}
 
-template<typename Entry, typename Key>
-HashFind findImpl(Hashtable<Entry>& h, Key key)
+template<typename T>
+HashFind findImpl(const Hashtable<T>& h, u64 key)
 {
 	HashFind find;
-	find.hashIndex = NULL_ENTRY;
 	find.dataPrev = NULL_ENTRY;
 	find.dataIndex = NULL_ENTRY;
 
-	if (h.hash.empty())
+	if (h.hash.size() == 0)
 		return find;
 
-	find.hashIndex = key % h.hash.size();
-	find.dataIndex = h.hash[find.hashIndex];
+	find.dataIndex = *bucketHead(h, key);
 	while (find.dataIndex != NULL_ENTRY)
 	{
 		if (h.data[find.dataIndex].key == key)
@@ -86,132 +136,215 @@ HashFind findImpl(Hashtable<Entry>& h, Key key)
 	return find;
 }
 
-template<typename Entry>
-bool isFull(const Hashtable<Entry>& h)
+template<typename T>
+T* find(Hashtable<T>& h, u64 key)
 {
-	constexpr float kMaxLoadFactor = 0.7f;
-	return (float)h.data.size() >= (float)h.hash.size() * kMaxLoadFactor;
+	const HashFind f = findImpl(h, key);
+	return f.dataIndex != NULL_ENTRY ? &h.data[f.dataIndex].value : nullptr;
 }
 
-template<typename T, typename Key>
-u32 addEntry(Hashtable<T>& h, Key key)
+template<typename T>
+const T* find(const Hashtable<T>& h, u64 key)
 {
-	typename Hashtable<T>::Entry e;
-	e.key = key;
-	e.next = NULL_ENTRY;
-	u32 ei = h.data.size();
-	h.data.push_back(e);
+	const HashFind f = findImpl(h, key);
+	return f.dataIndex != NULL_ENTRY ? &h.data[f.dataIndex].value : nullptr;
+}
+
+template<typename T>
+bool isFull(const Hashtable<T>& h)
+{
+	return (float)h.data.size() >= (float)h.hash.size() * MAX_LOAD_FACTOR;
+}
+
+template<typename T>
+u32 addEntry(Hashtable<T>& h, u64 key)
+{
+	const u32 ei = (u32)h.data.size();
+	typename Hashtable<T>::Entry* e = (typename Hashtable<T>::Entry*)h.data.push_back_uninit();
+	e->key = key;
+	e->next = NULL_ENTRY;
 	return ei;
 }
 
-template<typename Entry>
-void eraseImpl(Hashtable<Entry>& h, const HashFind& find)
+// Unlinks the entry, then fills the hole with the last entry so data stays dense. The link that
+// pointed at the last entry is found by index, a duplicate key can not redirect it.
+template<typename T>
+void eraseImpl(Hashtable<T>& h, const HashFind& find)
 {
+	using Entry = typename Hashtable<T>::Entry;
+
 	if (find.dataPrev == NULL_ENTRY)
-		h.hash[find.hashIndex] = h.data[find.dataIndex].next;
+		*bucketHead(h, h.data[find.dataIndex].key) = h.data[find.dataIndex].next;
 	else
 		h.data[find.dataPrev].next = h.data[find.dataIndex].next;
 
-	if (find.dataIndex == h.data.size() - 1)
+	const u32 last = (u32)h.data.size() - 1;
+	if (find.dataIndex != last)
 	{
-		h.data.resize(h.data.size() - 1);
-		return;
-	}
-
-	h.data[find.dataIndex] = h.data[h.data.size() - 1];
-	HashFind last = findImpl(h, h.data[find.dataIndex].key);
+		u32* link = bucketHead(h, h.data[last].key);
+		while (*link != last)
+		{
+			link = &h.data[*link].next;
+		}
+		*link = find.dataIndex;
 
-	if (last.dataPrev != NULL_ENTRY)
-	{
-		h.data[last.dataPrev].setNext(find.dataIndex);
-	}
-	else
-	{
-		h.hash[last.hashIndex] = find.dataIndex;
+		alignas(Entry) u8 tmp[sizeof(Entry)];
+		memcpy(tmp, &h.data[find.dataIndex], sizeof(Entry));
+		memcpy((void*)&h.data[find.dataIndex], &h.data[last], sizeof(Entry));
+		memcpy((void*)&h.data[last], tmp, sizeof(Entry));
 	}
+
+	h.data.resize((i32)last);
 }
 
-template<typename Entry, typename Key>
-void erase(Hashtable<Entry>& h, Key key)
+template<typename T>
+void erase(Hashtable<T>& h, u64 key)
 {
+	if (h.oldHash.size() != 0)
+		hashtable::migrate(h, MIGRATE_BUCKETS);
+
 	const HashFind find = findImpl(h, key);
 	if (find.dataIndex != NULL_ENTRY)
 		eraseImpl(h, find);
 }
 
-template<typename Entry, typename Key>
-u32 insertImpl(Hashtable<Entry>& h, Key key)
+// New entries go to the head of their chain, no walk needed.
+template<typename T>
+u32 insertImpl(Hashtable<T>& h, u64 key)
 {
-	const HashFind find = findImpl(h, key);
+	u32* head = bucketHead(h, key);
 	const u32 i = addEntry(h, key);
-
-	if (find.dataPrev == NULL_ENTRY)
-	{
-		h.hash[find.hashIndex] = i;
-	}
-	else
-	{
-		h.data[find.dataPrev].next = i;
-	}
-
-	h.data[i].next = find.dataIndex;
+	h.data[i].next = *head;
+	*head = i;
 	return i;
 }
 
-template<typename Entry, typename Key, typename Value>
-void insert(Hashtable<Entry>& h, Key key, Value&& value)
+// Takes ownership of value, which is left zeroed.
+template<typename T, typename Value>
+void insert(Hashtable<T>& h, u64 key, Value&& value)
 {
-	if (h.hash.empty())
+	if (h.oldHash.size() != 0)
+		hashtable::migrate(h, MIGRATE_BUCKETS);
+
+	if (h.hash.size() == 0 || hashtable::isFull(h))
 		hashtable::grow(h);
 
 	const u32 i = hashtable::insertImpl(h, key);
-	
-	memcpy(&h.data[i].value, &value, sizeof(Value));
-	memset(&value, 0, sizeof(Value));
 
-	if (hashtable::isFull(h))
-	{
-		hashtable::grow(h);
-	}
+	memcpy((void*)&h.data[i].value, &value, sizeof(T));
+	memset((void*)&value, 0, sizeof(T));
+}
+
+constexpr u32 log2OfPow2(u32 n)
+{
+	return n > 1 ? 1 + log2OfPow2(n / 2) : 0;
 }
 
+// Entries stay where they are, only the bucket heads and next links are rebuilt. Relinks every
+// entry, so an incremental rehash in progress is simply dropped.
 template<typename T>
 void rehash(Hashtable<T>& h, u32 newSize)
 {
-	Hashtable<T> nh;
+	if (h.oldHash.size() != 0)
+	{
+		h.oldHash.clear();
+		h.oldHash.shrink_to_fit();
+		h.migrated = 0;
+	}
 
+	u32 buckets = MIN_BUCKETS;
+	h.shift = 64 - log2OfPow2(MIN_BUCKETS);
+	while (buckets < newSize)
+	{
+		buckets *= 2;
+		--h.shift;
+	}
+	newSize = buckets;
 
-	nh.hash.resize(newSize);
-	nh.data.reserve(h.data.size());
+	h.hash.resize((i32)newSize);
+	memset(h.hash.begin(), 0xFF, sizeof(u32) * newSize);
 
-	for (u32 i = 0; i < newSize; ++i)
+	for (u32 i = 0; i < (u32)h.data.size(); ++i)
 	{
-		nh.hash[i] = NULL_ENTRY;
+		const u32 b = bucketIndex(h, h.data[i].key);
+		h.data[i].next = h.hash[b];
+		h.hash[b] = i;
 	}
+}
 
-	for (u32 i = 0; i < h.data.size(); ++i)
+// Incremental growth swaps the bucket array out and starts the new one empty, chains move over
+// in migrate.
+template<typename T>
+void grow(Hashtable<T>& h)
+{
+	if (!h.incremental || h.hash.size() == 0)
 	{
-		auto& e = h.data[i];
-		hashtable::insert(nh, e.key, static_cast<T&&>(e.value));
+		rehash(h, (u32)h.hash.size() * 2);
+		return;
 	}
 
-	if (h.hash.empty())
+	if (h.oldHash.size() != 0)
+		hashtable::migrate(h, (u32)h.oldHash.size());
+
+	const u32 newSize = (u32)h.hash.size() * 2;
+	h.oldHash.swap(h.hash);
+	h.oldShift = h.shift;
+	h.migrated = 0;
+	--h.shift;
+
+	h.hash.resize_uninit((i32)newSize);
+	memset(h.hash.begin(), 0xFF, sizeof(u32) * newSize);
+}
+
+// With twice the buckets old bucket b splits into new buckets 2b and 2b + 1, which take no entries
+// before b is migrated. Appending at their tails keeps the chain order, so shadowing is unchanged.
+template<typename T>
+void migrate(Hashtable<T>& h, u32 buckets)
+{
+	const u32 oldSize = (u32)h.oldHash.size();
+	const u32 end = oldSize - h.migrated > buckets ? h.migrated + buckets : oldSize;
+
+	for (; h.migrated < end; ++h.migrated)
 	{
-		h.hash.swap(nh.hash);
-		//h.hash.attach(nh.hash.detach());
+		const u32 b = h.migrated;
+		u32* tails[2] = {&h.hash[(i32)(2 * b)], &h.hash[(i32)(2 * b + 1)]};
+
+		for (u32 i = h.oldHash[(i32)b]; i != NULL_ENTRY; i = h.data[i].next)
+		{
+			u32*& tail = tails[bucketIndex(h, h.data[i].key) & 1];
+			*tail = i;
+			tail = &h.data[i].next;
+		}
+
+		*tails[0] = NULL_ENTRY;
+		*tails[1] = NULL_ENTRY;
 	}
-	else
+
+	if (h.migrated == oldSize)
 	{
-		h.data.swap(nh.data);
-		h.hash.swap(nh.hash);
+		h.oldHash.clear();
+		h.oldHash.shrink_to_fit();
+		h.migrated = 0;
 	}
 }
 
-template<typename Entry>
-void grow(Hashtable<Entry>& h)
+template<typename T>
+void build(Hashtable<T>& h, const u64* keys, const T* values, u32 n)
 {
-	const u32 newSize = h.data.size() * 2 + 10;
-	rehash(h, newSize);
+	using Entry = typename Hashtable<T>::Entry;
+
+	h.data.clear();
+	h.hash.clear();
+
+	h.data.resize_uninit((i32)n);
+	Entry* data = h.data.begin();
+	for (u32 i = 0; i < n; ++i)
+	{
+		data[i].key = keys[i];
+		new (&data[i].value) T(values[i]);
+	}
+
+	rehash(h, (u32)(n / MAX_LOAD_FACTOR) + 1);
 }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,77 @@
+#include "LargeAllocator.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+static constexpr u64 PAGE_SIZE = 4096;
+
+static u64 page_round(u64 size)
+{
+	return (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+void* LargeAllocator::alloc(u64 size)
+{
+#if defined(_WIN32)
+	void* block = VirtualAlloc(nullptr, page_round(size), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* block = mmap(nullptr, page_round(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	block = block != MAP_FAILED ? block : nullptr;
+#endif
+	if (block)
+	{
+		m_stats.on_alloc(size);
+		m_mapped.fetch_add(page_round(size), std::memory_order_relaxed);
+	}
+	return block;
+}
+
+void LargeAllocator::free(void* block, u64 size)
+{
+	m_stats.on_free(size);
+	m_mapped.fetch_sub(page_round(size), std::memory_order_relaxed);
+
+#if defined(_WIN32)
+	VirtualFree(block, 0, MEM_RELEASE);
+#else
+	munmap(block, page_round(size));
+#endif
+}
+
+void* LargeAllocator::try_expand(void* block, u64 size, u64 newSize)
+{
+	if (page_round(newSize) == page_round(size))
+	{
+		m_stats.on_expand(size, newSize);
+		return block;
+	}
+
+#if defined(__linux__)
+	void* moved = mremap(block, page_round(size), page_round(newSize), MREMAP_MAYMOVE);
+	if (moved == MAP_FAILED)
+		return nullptr;
+
+	m_stats.on_expand(size, newSize);
+	m_mapped.fetch_add(page_round(newSize) - page_round(size), std::memory_order_relaxed);
+	return moved;
+#else
+	return nullptr;
+#endif
+}
+
+void LargeAllocator::note_copy(void* /*block*/, u64 bytes)
+{
+	m_stats.on_copy(bytes);
+}
+
+AllocatorStats LargeAllocator::stats() const
+{
+	AllocatorStats stats = m_stats.load();
+	stats.bytes_reserved = m_mapped.load(std::memory_order_relaxed);
+	return stats;
+}
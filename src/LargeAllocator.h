@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Array.h"
+#include "Core.h"
+
+// Every block is its own page aligned mapping straight from the OS, meant for arrays of many
+// megabytes. On Linux try_expand is mremap, the kernel grows the mapping in place or moves its
+// pages to a new address, so nothing is copied however big the array gets. Elsewhere it always
+// falls back to copying.
+class LargeAllocator : public Allocator
+{
+public:
+	LargeAllocator() = default;
+	~LargeAllocator() override = default;
+
+	void* alloc(u64 size) override;
+	void free(void* block, u64 size) override;
+	void* try_expand(void* block, u64 size, u64 newSize) override;
+	void note_copy(void* block, u64 bytes) override;
+
+	// Reserved counts whole pages.
+	AllocatorStats stats() const override;
+
+private:
+	SharedAllocatorStats m_stats;
+	std::atomic<u64> m_mapped{0};
+};
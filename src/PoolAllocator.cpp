@@ -0,0 +1,409 @@
+#include "PoolAllocator.h"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// A thread's magazine for a class holds up to two batches. Past that one batch goes to the depot,
+// an empty magazine takes one batch back, or carves one from the current block when the depot is
+// empty too. Batches are about MAGAZINE_BYTES so big classes do not pile up per thread.
+static constexpr u64 MAGAZINE_BYTES = 16 << 10;
+static constexpr u32 MIN_BATCH = 4;
+static constexpr u32 MAX_BATCH = 64;
+// Pools one thread can have magazines in at once, the least recent is given back for a new one.
+static constexpr u32 POOL_THREAD_SLOTS = 4;
+
+static u32 highest_bit(u64 x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return index;
+#else
+	return 63 - __builtin_clzll(x);
+#endif
+}
+
+static u32 size_class(u64 size)
+{
+	if (size <= 256)
+		return size ? (u32)((size - 1) >> 4) : 0;
+
+	const u32 bits = highest_bit(size - 1);
+	return 16 + (bits - 8) * 4 + (u32)((size - 1 - (1ULL << bits)) >> (bits - 2));
+}
+
+static constexpr u64 class_size(u32 c)
+{
+	if (c < 16)
+		return (c + 1) * 16;
+
+	const u32 bits = 8 + (c - 16) / 4;
+	return (1ULL << bits) + ((c - 16) % 4 + 1) * (1ULL << (bits - 2));
+}
+
+struct ClassBatches
+{
+	constexpr ClassBatches()
+		: batch()
+	{
+		for (u32 c = 0; c < POOL_CLASSES; ++c)
+		{
+			const u64 n = MAGAZINE_BYTES / class_size(c);
+			batch[c] = n < MIN_BATCH ? MIN_BATCH : (n > MAX_BATCH ? MAX_BATCH : (u32)n);
+		}
+	}
+
+	u32 batch[POOL_CLASSES];
+};
+
+static constexpr ClassBatches CLASS_BATCHES;
+
+static u32 class_batch(u32 c)
+{
+	return CLASS_BATCHES.batch[c];
+}
+
+static void*& next_of(void* block)
+{
+	return *(void**)block;
+}
+
+static std::mutex s_registryLock;
+static PoolAllocator* s_pools = nullptr;
+static std::atomic<u64> s_nextPoolId{1};
+
+struct PoolThreadSlot
+{
+	u64 owner;
+	PoolCache cache;
+};
+
+struct PoolThreadSlots
+{
+	PoolThreadSlot slots[POOL_THREAD_SLOTS] = {};
+	u32 next = 0;
+
+	~PoolThreadSlots()
+	{
+		for (PoolThreadSlot& slot : slots)
+		{
+			release(slot);
+		}
+	}
+
+	// The pool may be gone already, then its blocks went back with it and there is nothing to do.
+	static void release(PoolThreadSlot& slot)
+	{
+		if (slot.owner)
+		{
+			std::lock_guard<std::mutex> guard(s_registryLock);
+			for (PoolAllocator* pool = s_pools; pool; pool = pool->m_nextPool)
+			{
+				if (pool->m_id == slot.owner)
+				{
+					pool->flush(slot.cache);
+					break;
+				}
+			}
+		}
+
+		slot = PoolThreadSlot();
+	}
+};
+
+static thread_local PoolThreadSlots t_poolSlots;
+
+PoolAllocator::PoolAllocator(const PoolConfig& config, Allocator& large)
+	: m_large(large)
+	, m_threaded(config.thread_magazines)
+	, m_id(s_nextPoolId.fetch_add(1, std::memory_order_relaxed))
+	, m_nextPool(nullptr)
+	, m_local()
+	, m_block(nullptr)
+	, m_carve(nullptr)
+{
+	if (m_threaded)
+	{
+		std::lock_guard<std::mutex> guard(s_registryLock);
+		m_nextPool = s_pools;
+		s_pools = this;
+	}
+}
+
+PoolAllocator::~PoolAllocator()
+{
+	if (m_threaded)
+	{
+		std::lock_guard<std::mutex> guard(s_registryLock);
+		PoolAllocator** link = &s_pools;
+		while (*link != this)
+		{
+			link = &(*link)->m_nextPool;
+		}
+		*link = m_nextPool;
+
+		for (PoolThreadSlot& slot : t_poolSlots.slots)
+		{
+			if (slot.owner == m_id)
+				slot = PoolThreadSlot();
+		}
+	}
+
+	if (m_block)
+		return_block(m_block);
+}
+
+PoolCache& PoolAllocator::cache()
+{
+	if (!m_threaded)
+		return m_local;
+
+	PoolThreadSlots& thread = t_poolSlots;
+	PoolThreadSlot* empty = nullptr;
+	for (PoolThreadSlot& slot : thread.slots)
+	{
+		if (slot.owner == m_id)
+			return slot.cache;
+		if (!slot.owner && !empty)
+			empty = &slot;
+	}
+
+	if (!empty)
+	{
+		empty = &thread.slots[thread.next++ % POOL_THREAD_SLOTS];
+		PoolThreadSlots::release(*empty);
+	}
+
+	empty->owner = m_id;
+	return empty->cache;
+}
+
+void* PoolAllocator::alloc(u64 size)
+{
+	if (size > POOL_MAX_SIZE)
+	{
+		void* block = m_large.alloc(size);
+		if (block)
+		{
+			m_stats.on_alloc(size);
+			m_largeLive.fetch_add(size, std::memory_order_relaxed);
+		}
+		return block;
+	}
+
+	const u32 c = size_class(size);
+	PoolCache& cache = this->cache();
+	PoolMagazine& magazine = cache.magazines[c];
+
+	void* block = magazine.head;
+	if (block)
+	{
+		magazine.head = next_of(block);
+		--magazine.count;
+	}
+	else
+	{
+		block = refill(cache, c);
+		if (!block)
+			return nullptr;
+	}
+
+	++cache.allocs;
+	cache.alloc_bytes += size;
+	return block;
+}
+
+void PoolAllocator::free(void* block, u64 size)
+{
+	if (!block)
+		return;
+
+	if (size > POOL_MAX_SIZE)
+	{
+		m_stats.on_free(size);
+		m_largeLive.fetch_sub(size, std::memory_order_relaxed);
+		m_large.free(block, size);
+		return;
+	}
+
+	const u32 c = size_class(size);
+	PoolCache& cache = this->cache();
+	PoolMagazine& magazine = cache.magazines[c];
+
+	++cache.frees;
+	cache.free_bytes += size;
+
+	next_of(block) = magazine.head;
+	magazine.head = block;
+	++magazine.count;
+
+	if (m_threaded && magazine.count >= 2 * class_batch(c))
+		drain(cache, c, class_batch(c));
+}
+
+void* PoolAllocator::try_expand(void* block, u64 size, u64 newSize)
+{
+	if (size > POOL_MAX_SIZE)
+	{
+		void* moved = m_large.try_expand(block, size, newSize);
+		if (moved)
+		{
+			m_stats.on_expand(size, newSize);
+			m_largeLive.fetch_add(newSize - size, std::memory_order_relaxed);
+		}
+		return moved;
+	}
+
+	if (newSize > POOL_MAX_SIZE || size_class(newSize) != size_class(size))
+		return nullptr;
+
+	m_stats.on_expand(size, newSize);
+	return block;
+}
+
+void PoolAllocator::note_copy(void* /*block*/, u64 bytes)
+{
+	m_stats.on_copy(bytes);
+}
+
+// Takes a batch from the depot, or carves one, and hands out its first block. nullptr when the block
+// pool is out of memory.
+void* PoolAllocator::refill(PoolCache& cache, u32 c)
+{
+	u32 count = class_batch(c);
+	void* head = nullptr;
+
+	fold_stats(cache);
+
+	if (m_threaded)
+	{
+		Depot& depot = m_depots[c];
+		std::lock_guard<std::mutex> guard(depot.lock);
+		if (depot.head)
+		{
+			count = count < depot.count ? count : depot.count;
+			head = depot.head;
+			void* last = head;
+			for (u32 i = 1; i < count; ++i)
+			{
+				last = next_of(last);
+			}
+			depot.head = next_of(last);
+			depot.count -= count;
+			next_of(last) = nullptr;
+		}
+	}
+
+	if (!head)
+		head = carve(c, count);
+	if (!head)
+		return nullptr;
+
+	PoolMagazine& magazine = cache.magazines[c];
+	magazine.head = next_of(head);
+	magazine.count = count - 1;
+	return head;
+}
+
+// Moves the first count blocks of a magazine to the depot.
+void PoolAllocator::drain(PoolCache& cache, u32 c, u32 count)
+{
+	fold_stats(cache);
+
+	PoolMagazine& magazine = cache.magazines[c];
+	void* head = magazine.head;
+	void* last = head;
+	for (u32 i = 1; i < count; ++i)
+	{
+		last = next_of(last);
+	}
+	magazine.head = next_of(last);
+	magazine.count -= count;
+
+	Depot& depot = m_depots[c];
+	std::lock_guard<std::mutex> guard(depot.lock);
+	next_of(last) = depot.head;
+	depot.head = head;
+	depot.count += count;
+}
+
+void PoolAllocator::flush(PoolCache& cache)
+{
+	for (u32 c = 0; c < POOL_CLASSES; ++c)
+	{
+		if (cache.magazines[c].count)
+			drain(cache, c, cache.magazines[c].count);
+	}
+	fold_stats(cache);
+}
+
+void PoolAllocator::fold_stats(PoolCache& cache)
+{
+	if (cache.allocs)
+		m_stats.on_alloc(cache.alloc_bytes, cache.allocs);
+	if (cache.frees)
+		m_stats.on_free(cache.free_bytes, cache.frees);
+
+	cache.allocs = 0;
+	cache.frees = 0;
+	cache.alloc_bytes = 0;
+	cache.free_bytes = 0;
+}
+
+// Links up to count blocks of class c off the current block, the rest of a block too short for even
+// one is left behind. count is set to how many were linked, nullptr when no block could be had.
+void* PoolAllocator::carve(u32 c, u32& count)
+{
+	const u64 size = class_size(c);
+
+	std::unique_lock<std::mutex> guard(m_carveLock, std::defer_lock);
+	if (m_threaded)
+		guard.lock();
+
+	u8* end = m_block ? m_block->data + sizeof(m_block->data) : nullptr;
+	if (!m_block || m_carve + size > end)
+	{
+		Block* block = get_block();
+		if (!block)
+			return nullptr;
+
+		if (m_block)
+			m_wasted.fetch_add(end - m_carve, std::memory_order_relaxed);
+
+		block->header.prev = m_block;
+		m_block = block;
+		m_carve = (u8*)(((u64)block->data + 15) & ~15ULL);
+		end = block->data + sizeof(block->data);
+		m_reserved.fetch_add(sizeof(Block), std::memory_order_relaxed);
+	}
+
+	const u64 fit = (u64)(end - m_carve) / size;
+	count = fit < count ? (u32)fit : count;
+
+	u8* head = m_carve;
+	for (u32 i = 0; i + 1 < count; ++i)
+	{
+		next_of(head + i * size) = head + (i + 1) * size;
+	}
+	next_of(head + (count - 1) * size) = nullptr;
+
+	m_carve += count * size;
+	return head;
+}
+
+AllocatorStats PoolAllocator::stats() const
+{
+	AllocatorStats stats = m_stats.load();
+	if (!m_threaded)
+	{
+		stats.allocs += m_local.allocs;
+		stats.frees += m_local.frees;
+		stats.bytes_requested += m_local.alloc_bytes;
+		stats.bytes_live += m_local.alloc_bytes - m_local.free_bytes;
+		stats.bytes_peak = stats.bytes_peak > stats.bytes_live ? stats.bytes_peak : stats.bytes_live;
+	}
+	stats.bytes_reserved = m_reserved.load(std::memory_order_relaxed) + m_largeLive.load(std::memory_order_relaxed);
+	stats.bytes_wasted = m_wasted.load(std::memory_order_relaxed);
+	return stats;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "Array.h"
+#include "Core.h"
+#include "ScratchAllocator.h"
+
+// 16 byte steps up to 256, then four classes per power of 2 up to POOL_MAX_SIZE.
+static constexpr u32 POOL_CLASSES = 44;
+static constexpr u64 POOL_MAX_SIZE = 32 << 10;
+
+struct PoolConfig
+{
+	// Lets any thread allocate and free. Each thread keeps a magazine per size class in front of a
+	// locked depot. Without it the pool belongs to one thread and takes no locks.
+	bool thread_magazines = false;
+};
+
+// Intrusive free list of one size class.
+struct PoolMagazine
+{
+	void* head;
+	u32 count;
+};
+
+struct PoolCache
+{
+	PoolMagazine magazines[POOL_CLASSES];
+	// Not folded into the allocator's stats yet.
+	u64 allocs;
+	u64 frees;
+	u64 alloc_bytes;
+	u64 free_bytes;
+};
+
+// Size classed free lists over slabs carved from the block pool, alloc and free are a list pop and
+// push. free is told the size, so blocks carry no header. Blocks are 16 byte aligned and only reused
+// within their class, the slabs go back to the block pool when the allocator is destroyed. Sizes
+// above POOL_MAX_SIZE go to the large allocator.
+class PoolAllocator : public Allocator
+{
+public:
+	explicit PoolAllocator(const PoolConfig& config = PoolConfig(), Allocator& large = default_allocator());
+	~PoolAllocator() override;
+
+	PoolAllocator(const PoolAllocator&) = delete;
+	PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+	void* alloc(u64 size) override;
+	void free(void* block, u64 size) override;
+	// In place while the size class stays the same, large blocks are passed to the large allocator.
+	void* try_expand(void* block, u64 size, u64 newSize) override;
+	void note_copy(void* block, u64 bytes) override;
+
+	// Reserved is the carved blocks plus large allocations, wasted the block tails too short for the
+	// class that needed them. Counts are folded in per batch, with magazines they lag by up to a
+	// magazine per thread and the peak is only sampled then.
+	AllocatorStats stats() const override;
+
+private:
+	friend struct PoolThreadSlots;
+
+	struct alignas(64) Depot
+	{
+		std::mutex lock;
+		void* head = nullptr;
+		u32 count = 0;
+	};
+
+	PoolCache& cache();
+	void* refill(PoolCache& cache, u32 c);
+	void drain(PoolCache& cache, u32 c, u32 count);
+	void flush(PoolCache& cache);
+	void fold_stats(PoolCache& cache);
+	void* carve(u32 c, u32& count);
+
+	Allocator& m_large;
+	const bool m_threaded;
+	const u64 m_id;
+	// Pools with magazines are registered so exiting threads can give theirs back.
+	PoolAllocator* m_nextPool;
+
+	PoolCache m_local;
+	Depot m_depots[POOL_CLASSES];
+
+	std::mutex m_carveLock;
+	Block* m_block;
+	u8* m_carve;
+
+	SharedAllocatorStats m_stats;
+	std::atomic<u64> m_reserved{0};
+	std::atomic<u64> m_wasted{0};
+	std::atomic<u64> m_largeLive{0};
+};
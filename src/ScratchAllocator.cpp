@@ -1,11 +1,216 @@
 #include "ScratchAllocator.h"
 
+#include <atomic>
 #include <cstdio>
+#include <mutex>
 
-static Block* s_freeBlocks = nullptr;
+#include "LargeAllocator.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// Blocks are recycled through a small per thread cache in front of a sharded global free list.
+// Each thread has a home shard, a whole returned chain is spliced into it under one lock.
+// Blocks are mapped straight from the OS and only committed when touched. The shards keep at most
+// high_watermark idle blocks, anything returned beyond that is unmapped.
+
+static constexpr i32 THREAD_CACHE_BLOCKS = 4;
+static constexpr i32 BLOCK_SHARDS = 8;
+static constexpr u64 HUGE_PAGE_SIZE = 2 << 20;
+
+struct alignas(64) BlockShard
+{
+    std::mutex lock;
+    Block* head = nullptr;
+};
+
+static BlockShard s_shards[BLOCK_SHARDS];
+static std::atomic<u32> s_nextShard{0};
+static std::atomic<i32> s_idleBlocks{0};
+static std::atomic<i32> s_mappedBlocks{0};
+static std::atomic<bool> s_noHugetlb{false};
+static std::atomic<u64> s_cacheHits{0};
+static std::atomic<u64> s_poolHits{0};
+static std::atomic<u64> s_maps{0};
+static std::atomic<u64> s_unmaps{0};
+static i32 s_highWatermark = 32;
+
+// Explicit huge pages first, they only exist when the admin reserved some. Otherwise regular pages
+// on a huge page aligned range with a transparent huge page hint.
+static Block* map_block()
+{
+    Block* block = nullptr;
+    bool hugetlb = false;
+#if defined(_WIN32)
+    block = (Block*)VirtualAlloc(nullptr, sizeof(Block), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(__linux__)
+    if(!s_noHugetlb.load(std::memory_order_relaxed))
+    {
+        void* p = mmap(nullptr, sizeof(Block), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(p != MAP_FAILED)
+        {
+            block = (Block*)p;
+            hugetlb = true;
+        }
+        else
+        {
+            s_noHugetlb.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    if(!block)
+    {
+        u8* p = (u8*)mmap(nullptr, sizeof(Block) + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == (u8*)MAP_FAILED)
+        {
+            LIME_DEBUG_BREAK();
+            return nullptr;
+        }
+
+        u8* aligned = (u8*)(((u64)p + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        if(aligned > p)
+        {
+            munmap(p, aligned - p);
+        }
+        munmap(aligned + sizeof(Block), p + HUGE_PAGE_SIZE - aligned);
+
+#if defined(MADV_HUGEPAGE)
+        madvise(aligned, sizeof(Block), MADV_HUGEPAGE);
+#endif
+        block = (Block*)aligned;
+    }
+#else
+    block = (Block*)::malloc(sizeof(Block));
+#endif
+
+    if(!block)
+    {
+        LIME_DEBUG_BREAK();
+        return nullptr;
+    }
+
+    block->header.hugetlb = hugetlb;
+    s_mappedBlocks.fetch_add(1, std::memory_order_relaxed);
+    s_maps.fetch_add(1, std::memory_order_relaxed);
+    return block;
+}
+
+static void unmap_block(Block* block)
+{
+#if defined(_WIN32)
+    VirtualFree(block, 0, MEM_RELEASE);
+#elif defined(__linux__)
+    munmap(block, sizeof(Block));
+#else
+    ::free(block);
+#endif
+    s_mappedBlocks.fetch_sub(1, std::memory_order_relaxed);
+    s_unmaps.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Drops the pages behind data, the page holding the header stays because it holds the free list
+// link. Explicit huge pages can only be dropped whole, those blocks keep their first huge page.
+// Returns false when the OS refused.
+static bool decommit_block(Block* block)
+{
+    u64 keep = block->header.hugetlb ? HUGE_PAGE_SIZE : Block::PAGE_SIZE;
+    u8* first = (u8*)block + keep;
+    u64 size = sizeof(Block) - keep;
+#if defined(_WIN32)
+    return VirtualAlloc(first, size, MEM_RESET, PAGE_READWRITE) != nullptr;
+#elif defined(__linux__)
+    return madvise(first, size, MADV_DONTNEED) == 0;
+#else
+    (void)first;
+    (void)size;
+    return true;
+#endif
+}
+
+static void push_chain(BlockShard& shard, Block* first, Block* last)
+{
+    std::lock_guard<std::mutex> guard(shard.lock);
+    last->header.prev = shard.head;
+    shard.head = first;
+}
+
+static Block* pop_block(BlockShard& shard)
+{
+    std::lock_guard<std::mutex> guard(shard.lock);
+    Block* block = shard.head;
+    if(block)
+    {
+        shard.head = block->header.prev;
+        s_idleBlocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return block;
+}
+
+// Reserves room under the high watermark for up to count blocks, returns how many fit.
+static i32 claim_idle(i32 count)
+{
+    i32 idle = s_idleBlocks.fetch_add(count, std::memory_order_relaxed);
+    i32 fit = s_highWatermark - idle;
+    fit = fit < 0 ? 0 : (fit > count ? count : fit);
+    if(fit < count)
+    {
+        s_idleBlocks.fetch_sub(count - fit, std::memory_order_relaxed);
+    }
+    return fit;
+}
+
+struct ThreadBlockCache
+{
+    Block* blocks[THREAD_CACHE_BLOCKS];
+    i32 count = 0;
+    u32 shard = s_nextShard.fetch_add(1, std::memory_order_relaxed) % BLOCK_SHARDS;
+
+    ~ThreadBlockCache()
+    {
+        flush();
+    }
+
+    void flush()
+    {
+        for(i32 i = 0; i < count; ++i)
+        {
+            if(claim_idle(1))
+            {
+                push_chain(s_shards[shard], blocks[i], blocks[i]);
+            }
+            else
+            {
+                unmap_block(blocks[i]);
+            }
+        }
+        count = 0;
+    }
+};
+
+static thread_local ThreadBlockCache t_cache;
 
 void return_block(Block* block)
 {
+    ThreadBlockCache& cache = t_cache;
+
+    while(block && cache.count < THREAD_CACHE_BLOCKS)
+    {
+        Block* prev = block->header.prev;
+        cache.blocks[cache.count++] = block;
+        block = prev;
+    }
+
+    if(!block)
+    {
+        return;
+    }
+
+    i32 count = 1;
     Block* last = block;
     
     for(;;)
@@ -13,6 +218,7 @@ void return_block(Block* block)
         if(last->header.prev)
         {
             last = last->header.prev;
+            ++count;
         }
         else
         {
@@ -20,94 +226,426 @@ void return_block(Block* block)
         }
     }
 
-    last->header.prev = s_freeBlocks;
-    s_freeBlocks = block;
-}
+    // The part of the chain above the watermark goes back to the OS.
+    i32 keep = claim_idle(count);
+    if(keep == 0)
+    {
+        last = nullptr;
+    }
+    else
+    {
+        last = block;
+        for(i32 i = 1; i < keep; ++i)
+        {
+            last = last->header.prev;
+        }
+    }
+
+    Block* excess = last ? last->header.prev : block;
+    while(excess)
+    {
+        Block* prev = excess->header.prev;
+        unmap_block(excess);
+        excess = prev;
+    }
 
-static Block* dbg_block[32];
+    if(last)
+    {
+        push_chain(s_shards[cache.shard], block, last);
+    }
+}
 
 Block* get_block()
 {
-    Block* block = s_freeBlocks;
-    if(block)
+    ThreadBlockCache& cache = t_cache;
+    Block* block = nullptr;
+
+    if(cache.count > 0)
     {
-        s_freeBlocks = block->header.prev;
-        block->header.prev = nullptr;
-        return block;
+        block = cache.blocks[--cache.count];
+        s_cacheHits.fetch_add(1, std::memory_order_relaxed);
     }
-    else 
+
+    for(i32 i = 0; !block && i < BLOCK_SHARDS; ++i)
     {
-        block = (Block*)::malloc(sizeof(Block));
-        block->header.prev = nullptr;
-        return block;
+        block = pop_block(s_shards[(cache.shard + i) % BLOCK_SHARDS]);
+        if(block)
+        {
+            s_poolHits.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if(!block)
+    {
+        block = map_block();
+        if(!block)
+        {
+            return nullptr;
+        }
+    }
+
+    block->header.prev = nullptr;
+    return block;
+}
+
+void block_memory_init(const BlockMemoryConfig& config)
+{
+    s_highWatermark = config.high_watermark;
+
+    for(i32 i = 0; i < config.prefill && i < config.high_watermark; i++)
+    {
+        Block* block = map_block();
+        if(!block)
+        {
+            break;
+        }
+        s_idleBlocks.fetch_add(1, std::memory_order_relaxed);
+        push_chain(s_shards[i % BLOCK_SHARDS], block, block);
     }
 }
 
-void block_memory_init()
+void block_memory_trim()
 {
-    for(i32 i = 0; i < 32; i++)
+    for(BlockShard& shard : s_shards)
     {
-        Block* block = (Block*)::malloc(sizeof(Block));
-        memset(block, 0, sizeof(Block));
-        block->header.prev = s_freeBlocks;
-        s_freeBlocks = block;
-        dbg_block[i] = block;
+        std::lock_guard<std::mutex> guard(shard.lock);
+        Block** link = &shard.head;
+        while(*link)
+        {
+            Block* block = *link;
+            if(decommit_block(block))
+            {
+                link = &block->header.prev;
+                continue;
+            }
+
+            // Kernels before 5.18 can not drop huge pages in place, such a block goes back whole.
+            *link = block->header.prev;
+            s_idleBlocks.fetch_sub(1, std::memory_order_relaxed);
+            unmap_block(block);
+        }
     }
 }
 
+BlockMemoryStats block_memory_stats()
+{
+    BlockMemoryStats stats;
+    stats.mapped_blocks = s_mappedBlocks.load(std::memory_order_relaxed);
+    stats.idle_blocks = s_idleBlocks.load(std::memory_order_relaxed);
+    stats.cache_hits = s_cacheHits.load(std::memory_order_relaxed);
+    stats.pool_hits = s_poolHits.load(std::memory_order_relaxed);
+    stats.maps = s_maps.load(std::memory_order_relaxed);
+    stats.unmaps = s_unmaps.load(std::memory_order_relaxed);
+    return stats;
+}
+
 void block_memory_shutdown()
 {
+    t_cache.flush();
+
     i32 blocks_freed = 0;
-    Block* block = s_freeBlocks;
-    while(block)
+    for(BlockShard& shard : s_shards)
     {
-        Block* next = block->header.prev;
-        ::free(block);
-        ++blocks_freed;
-        block = next;
+        std::lock_guard<std::mutex> guard(shard.lock);
+        Block* block = shard.head;
+        while(block)
+        {
+            Block* next = block->header.prev;
+            unmap_block(block);
+            ++blocks_freed;
+            block = next;
+        }
+        shard.head = nullptr;
     }
+    s_idleBlocks.store(0, std::memory_order_relaxed);
 		
     printf("Blocks freed %d\n", blocks_freed);
 }
 
+// Allocations that do not fit an empty block get their own mapping. The header sits right in front
+// of the returned pointer, inside the first page of the mapping.
+struct OversizeBlock
+{
+    OversizeBlock* prev;
+    OversizeBlock* next;
+    u64 mapped;
+    u64 serial;
+};
+
+static constexpr u64 OVERSIZE_THRESHOLD = sizeof(Block::data) - Block::PAGE_SIZE;
+
+static LargeAllocator s_oversizePages;
+
+static u64 oversize_offset(u64 alignment)
+{
+    return (sizeof(OversizeBlock) + alignment - 1) & ~(alignment - 1);
+}
+
+static u64 page_round(u64 size)
+{
+    return (size + Block::PAGE_SIZE - 1) & ~(u64)(Block::PAGE_SIZE - 1);
+}
+
+static void add_live(AllocatorStats& stats, u64 size)
+{
+    stats.bytes_live += size;
+    if(stats.bytes_live > stats.bytes_peak)
+    {
+        stats.bytes_peak = stats.bytes_live;
+    }
+}
+
+static OversizeBlock* oversize_header(void* data)
+{
+    return (OversizeBlock*)data - 1;
+}
+
+static u8* oversize_base(void* data)
+{
+    return (u8*)(((u64)data - 1) & ~(u64)(Block::PAGE_SIZE - 1));
+}
+
 ScratchPadAllocator::ScratchPadAllocator()
 {
     m_current = get_block();
+    if(!m_current)
+    {
+        lime_fatal("Out of memory for a scratch block");
+    }
     m_pos = 0;
+    m_oversize = nullptr;
+    m_oversizeSerial = 0;
+    m_stats.bytes_reserved = sizeof(Block);
 }
 
 ScratchPadAllocator::~ScratchPadAllocator()
 {
     return_block(m_current);
+    release_oversize(0);
 }
 
-void* ScratchPadAllocator::alloc(i32 size)
+void* ScratchPadAllocator::alloc(u64 size)
 {
-   i32 size_with_alignment = size + 16 - (size & 15);
+    return alloc(size, 16);
+}
 
-    if(size_with_alignment > Block::BLOCK_SIZE)
+void* ScratchPadAllocator::alloc(u64 size, u64 alignment)
+{
+    if(alignment == 0 || alignment > Block::PAGE_SIZE || (alignment & (alignment - 1)))
     {
-        __debugbreak();
+        LIME_DEBUG_BREAK();
         return nullptr;
     }
 
-    if(size_with_alignment + m_pos > Block::BLOCK_SIZE)
+    if(size > OVERSIZE_THRESHOLD)
+    {
+        return alloc_oversize(size, alignment);
+    }
+
+    u8* top = &m_current->data[m_pos];
+    u8* p = (u8*)(((u64)top + alignment - 1) & ~(alignment - 1));
+
+    if(p + size > m_current->data + sizeof(m_current->data))
     {
         Block* next = get_block();
+        if(!next)
+        {
+            return nullptr;
+        }
+
+        m_stats.bytes_wasted += sizeof(m_current->data) - m_pos;
+        m_stats.bytes_reserved += sizeof(Block);
+
         next->header.prev = m_current;
         m_current = next;
-        m_pos = 0;
-        return alloc(size);
+        top = m_current->data;
+        p = (u8*)(((u64)top + alignment - 1) & ~(alignment - 1));
+    }
+
+    ++m_stats.allocs;
+    m_stats.bytes_requested += size;
+    m_stats.bytes_wasted += p - top;
+    add_live(m_stats, size);
+
+    m_pos = (i32)(p + size - m_current->data);
+    return p;
+}
+
+void* ScratchPadAllocator::alloc_oversize(u64 size, u64 alignment)
+{
+    u64 offset = oversize_offset(alignment);
+    u8* base = (u8*)s_oversizePages.alloc(offset + size);
+    if(!base)
+    {
+        LIME_DEBUG_BREAK();
+        return nullptr;
+    }
+
+    OversizeBlock* header = oversize_header(base + offset);
+    header->prev = m_oversize;
+    header->next = nullptr;
+    header->mapped = offset + size;
+    header->serial = ++m_oversizeSerial;
+
+    if(m_oversize)
+    {
+        m_oversize->next = header;
+    }
+    m_oversize = header;
+
+    ++m_stats.allocs;
+    m_stats.bytes_requested += size;
+    m_stats.bytes_reserved += page_round(offset + size);
+    add_live(m_stats, size);
+
+    return base + offset;
+}
+
+void ScratchPadAllocator::unlink_oversize(OversizeBlock* header)
+{
+    if(header->next)
+    {
+        header->next->prev = header->prev;
     }
     else
     {
-        i32 pos = m_pos;
-        m_pos += size_with_alignment;
-        return (void*)&m_current->data[pos];
+        m_oversize = header->prev;
+    }
+
+    if(header->prev)
+    {
+        header->prev->next = header->next;
     }
 }
 
-void ScratchPadAllocator::free(void* data, i32 size)
+// Unmaps every oversize allocation made at or after serial.
+void ScratchPadAllocator::release_oversize(u64 serial)
 {
-    // Do nothing
-}
\ No newline at end of file
+    while(m_oversize && m_oversize->serial >= serial)
+    {
+        OversizeBlock* prev = m_oversize->prev;
+        m_stats.bytes_reserved -= page_round(m_oversize->mapped);
+        s_oversizePages.free(oversize_base(m_oversize + 1), m_oversize->mapped);
+        m_oversize = prev;
+    }
+
+    if(m_oversize)
+    {
+        m_oversize->next = nullptr;
+    }
+}
+
+void ScratchPadAllocator::free(void* data, u64 size)
+{
+    ++m_stats.frees;
+    m_stats.bytes_live -= size;
+
+    if(size > OVERSIZE_THRESHOLD)
+    {
+        OversizeBlock* header = oversize_header(data);
+        unlink_oversize(header);
+        m_stats.bytes_reserved -= page_round(header->mapped);
+        s_oversizePages.free(oversize_base(data), header->mapped);
+        return;
+    }
+
+    if((u8*)data + size == &m_current->data[m_pos])
+    {
+        m_pos = (i32)((u8*)data - m_current->data);
+    }
+}
+
+void* ScratchPadAllocator::try_expand(void* block, u64 size, u64 newSize)
+{
+    if(size > OVERSIZE_THRESHOLD)
+    {
+        OversizeBlock* header = oversize_header(block);
+        u8* base = oversize_base(block);
+        u64 offset = (u8*)block - base;
+        OversizeBlock* prev = header->prev;
+        OversizeBlock* next = header->next;
+
+        u8* moved = (u8*)s_oversizePages.try_expand(base, header->mapped, offset + newSize);
+        if(!moved)
+        {
+            return nullptr;
+        }
+
+        header = oversize_header(moved + offset);
+        m_stats.bytes_reserved += page_round(offset + newSize) - page_round(header->mapped);
+        header->mapped = offset + newSize;
+        if(prev)
+        {
+            prev->next = header;
+        }
+        if(next)
+        {
+            next->prev = header;
+        }
+        else
+        {
+            m_oversize = header;
+        }
+
+        ++m_stats.expands;
+        m_stats.bytes_requested += newSize - size;
+        add_live(m_stats, newSize - size);
+        return moved + offset;
+    }
+
+    if(newSize > OVERSIZE_THRESHOLD || (u8*)block + size != &m_current->data[m_pos])
+    {
+        return nullptr;
+    }
+
+    if((u8*)block + newSize > m_current->data + sizeof(m_current->data))
+    {
+        return nullptr;
+    }
+
+    m_pos = (i32)((u8*)block + newSize - m_current->data);
+
+    ++m_stats.expands;
+    m_stats.bytes_requested += newSize - size;
+    add_live(m_stats, newSize - size);
+    return block;
+}
+
+void ScratchPadAllocator::note_copy(void* /*block*/, u64 bytes)
+{
+    m_stats.bytes_copied += bytes;
+}
+
+AllocatorStats ScratchPadAllocator::stats() const
+{
+    return m_stats;
+}
+
+ScratchMarker ScratchPadAllocator::get_marker() const
+{
+    return ScratchMarker{m_current, m_pos, m_oversizeSerial + 1, m_stats.bytes_live, m_stats.bytes_wasted};
+}
+
+void ScratchPadAllocator::rewind(ScratchMarker marker)
+{
+    if(m_current != marker.block)
+    {
+        Block* oldest = m_current;
+        i32 count = 1;
+        while(oldest->header.prev != marker.block)
+        {
+            oldest = oldest->header.prev;
+            ++count;
+        }
+        m_stats.bytes_reserved -= count * sizeof(Block);
+
+        oldest->header.prev = nullptr;
+        return_block(m_current);
+        m_current = marker.block;
+    }
+
+    m_pos = marker.pos;
+    release_oversize(marker.oversize);
+    m_stats.bytes_live = marker.live;
+    m_stats.bytes_wasted = marker.wasted;
+}
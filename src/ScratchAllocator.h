@@ -1,14 +1,18 @@
+#pragma once
+
 #include "Array.h"
 #include "Core.h"
 
 struct Block
 {
 	static constexpr i32 PAGE_SIZE = 4096;
-	// 4 megabyte blocks
+	// 16 megabyte blocks, a whole number of 2 MB huge pages
 	static constexpr i32 BLOCK_SIZE = 16 * 256 * PAGE_SIZE;
 	struct Header
 	{
 		Block* prev;
+		// Set by the pool, the block is backed by explicit huge pages.
+		bool hugetlb;
 	};
 
 	Header header;
@@ -16,9 +20,54 @@ struct Block
 	u8 data[BLOCK_SIZE-sizeof(Header)];
 };
 
-void block_memory_init();
+struct BlockMemoryConfig
+{
+	// Idle blocks the pool keeps mapped, blocks returned beyond this are unmapped.
+	i32 high_watermark = 32;
+	// Blocks mapped by init. Their pages are committed on first touch, not up front.
+	i32 prefill = 32;
+};
+
+struct BlockMemoryStats
+{
+	i32 mapped_blocks;
+	i32 idle_blocks;
+	// Where get_block found its blocks since init: the thread cache, a pool shard or a fresh mapping.
+	u64 cache_hits;
+	u64 pool_hits;
+	u64 maps;
+	// Blocks given back to the OS, beyond the high watermark or at shutdown.
+	u64 unmaps;
+};
+
+void block_memory_init(const BlockMemoryConfig& config = BlockMemoryConfig());
 void block_memory_shutdown();
 
+// Gives the pages of every idle pooled block back to the OS, the mappings stay for reuse. A block
+// whose huge pages can not be dropped in place is unmapped instead.
+void block_memory_trim();
+
+BlockMemoryStats block_memory_stats();
+
+// The block pool itself, for allocators that carve blocks up. A returned block takes its prev
+// chain back with it. get_block returns nullptr when the OS has no memory left.
+Block* get_block();
+void return_block(Block* block);
+
+// Position in a scratch allocator, everything allocated after it can be released at once.
+struct ScratchMarker
+{
+	Block* block;
+	i32 pos;
+	// First oversize allocation serial made after the marker.
+	u64 oversize;
+	// Stats to restore, everything after the marker is gone.
+	u64 live;
+	u64 wasted;
+};
+
+struct OversizeBlock;
+
 struct ScratchPadAllocator : public Allocator
 {
 	ScratchPadAllocator();
@@ -30,9 +79,59 @@ struct ScratchPadAllocator : public Allocator
 	ScratchPadAllocator& operator=(const ScratchPadAllocator&) = delete;
 	ScratchPadAllocator& operator=(ScratchPadAllocator&&) = delete;
 
-	void* alloc(i32 size) override;
-	void free(void* block, i32 size) override;
+	// 16 byte aligned.
+	void* alloc(u64 size) override;
+	// alignment is a power of 2 up to Block::PAGE_SIZE, at most alignment - 1 bytes go to padding.
+	// Sizes that do not fit an empty block get their own mapping, freed with the allocator. Returns
+	// nullptr for a bad alignment or when the OS has no memory left.
+	void* alloc(u64 size, u64 alignment);
+	// Oversize allocations are unmapped right away. Otherwise only the newest allocation is given
+	// back, by moving m_pos, anything else waits for a rewind.
+	void free(void* block, u64 size) override;
+	// The newest allocation of the current block grows by moving m_pos, oversize ones are remapped.
+	void* try_expand(void* block, u64 size, u64 newSize) override;
+	void note_copy(void* block, u64 bytes) override;
+
+	// Reserved is the whole block chain plus the oversize mappings, wasted counts alignment padding
+	// and the tail each block is left with when an allocation does not fit it.
+	AllocatorStats stats() const override;
+
+	ScratchMarker get_marker() const;
+	// Releases everything allocated since marker in LIFO order, blocks taken after it go back to the pool.
+	void rewind(ScratchMarker marker);
+private:
+	void* alloc_oversize(u64 size, u64 alignment);
+	void unlink_oversize(OversizeBlock* header);
+	void release_oversize(u64 serial);
+
 private:
 	Block* m_current;
 	i32 m_pos;
+	// Newest oversize allocation, linked to older ones through prev.
+	OversizeBlock* m_oversize;
+	u64 m_oversizeSerial;
+
+	AllocatorStats m_stats;
+};
+
+// Rewinds the allocator to where it was when the scope was opened.
+struct ScratchScope
+{
+	explicit ScratchScope(ScratchPadAllocator& allocator)
+		: m_allocator(allocator)
+		, m_marker(allocator.get_marker())
+	{
+	}
+
+	~ScratchScope()
+	{
+		m_allocator.rewind(m_marker);
+	}
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+private:
+	ScratchPadAllocator& m_allocator;
+	ScratchMarker m_marker;
 };
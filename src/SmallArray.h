@@ -0,0 +1,439 @@
+#pragma once
+
+#include <cstring>
+#include <new>
+
+#include "Array.h"
+
+// Array that keeps its first N elements inside the object and only goes to the allocator once it
+// outgrows them. The heap pointer shares the inline bytes, the capacity says which one is live, so
+// nothing points into the object and it relocates by memcpy whenever its elements do.
+template<typename T, i32 N>
+class SmallArray
+{
+	static_assert(N > 0, "SmallArray needs at least one inline element");
+
+public:
+	explicit SmallArray(Allocator& allocator);
+	~SmallArray();
+
+	// Deep copy on the same allocator.
+	SmallArray(const SmallArray& r);
+	// Takes r's heap buffer and allocator, inline elements are moved one by one.
+	SmallArray(SmallArray&& r);
+
+	SmallArray& operator=(const SmallArray& r);
+	// Takes r's heap buffer when both use the same allocator, otherwise moves the elements over.
+	SmallArray& operator=(SmallArray&& r);
+
+	void push_back(const T& val);
+	void push_back(T&& val);
+	template<typename... Args>
+	T& emplace_back(Args&&... args);
+	T& back();
+
+	void* push_back_uninit();
+
+	void resize(i32 new_size);
+	// Sets the size without constructing anything, the caller fills the new elements.
+	void resize_uninit(i32 new_size);
+	void reserve(i32 new_capacity);
+	// Drops unused heap capacity, contents that fit move back inline.
+	void shrink_to_fit();
+
+	void clear();
+
+	// Exchanges contents, both arrays have to use the same allocator.
+	void swap(SmallArray& r);
+
+
+	T& operator[](i32 i);
+	const T& operator[](i32 i) const;
+
+
+	i32 size() const { return m_size; }
+	i32 capacity() const { return m_capacity; }
+	bool is_inline() const { return m_capacity == N; }
+
+	T* begin();
+	T* end();
+	const T* begin() const;
+	const T* end() const;
+
+private:
+	void grow();
+	void free_heap();
+	void take(SmallArray& r);
+	static void relocate(T* to, T* from, i32 count);
+	T* data() { return is_inline() ? (T*)m_storage.inline_bytes : m_storage.heap; }
+	const T* data() const { return is_inline() ? (const T*)m_storage.inline_bytes : m_storage.heap; }
+private:
+	Allocator& m_allocator;
+
+	union Storage
+	{
+		T* heap;
+		alignas(T) u8 inline_bytes[sizeof(T) * N];
+	} m_storage;
+
+	i32 m_size = 0;
+	i32 m_capacity = N;
+};
+
+template <typename T, i32 N>
+SmallArray<T, N>::SmallArray(Allocator& allocator)
+	: m_allocator(allocator)
+{
+
+}
+
+template <typename T, i32 N>
+SmallArray<T, N>::~SmallArray()
+{
+	T* items = data();
+	for (i32 i = 0; i < m_size; ++i)
+	{
+		items[i].~T();
+	}
+
+	if (!is_inline())
+	{
+		m_allocator.free(m_storage.heap, m_capacity * sizeof(T));
+	}
+
+	m_capacity = N;
+	m_size = 0;
+}
+
+template <typename T, i32 N>
+SmallArray<T, N>::SmallArray(const SmallArray& r)
+	: m_allocator(r.m_allocator)
+{
+	*this = r;
+}
+
+template <typename T, i32 N>
+SmallArray<T, N>::SmallArray(SmallArray&& r)
+	: m_allocator(r.m_allocator)
+{
+	take(r);
+}
+
+template <typename T, i32 N>
+SmallArray<T, N>& SmallArray<T, N>::operator=(const SmallArray& r)
+{
+	if (this == &r)
+		return *this;
+
+	clear();
+	reserve(r.m_size);
+
+	T* items = data();
+	const T* from = r.data();
+	for (i32 i = 0; i < r.m_size; ++i)
+	{
+		new (&items[i]) T(from[i]);
+	}
+
+	m_size = r.m_size;
+	return *this;
+}
+
+template <typename T, i32 N>
+SmallArray<T, N>& SmallArray<T, N>::operator=(SmallArray&& r)
+{
+	if (this == &r)
+		return *this;
+
+	clear();
+
+	if (&m_allocator == &r.m_allocator || r.is_inline())
+	{
+		free_heap();
+		take(r);
+		return *this;
+	}
+
+	reserve(r.m_size);
+	T* items = data();
+	for (i32 i = 0; i < r.m_size; ++i)
+	{
+		new (&items[i]) T(std::move(r.m_storage.heap[i]));
+	}
+	m_size = r.m_size;
+	r.clear();
+	return *this;
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::push_back(const T& val)
+{
+	emplace_back(val);
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::push_back(T&& val)
+{
+	emplace_back(std::move(val));
+}
+
+template <typename T, i32 N>
+template <typename... Args>
+T& SmallArray<T, N>::emplace_back(Args&&... args)
+{
+	if (m_size == m_capacity)
+	{
+		// args may point into the buffer that growth frees, build the element first.
+		T val(std::forward<Args>(args)...);
+		grow();
+		new (&data()[m_size]) T(std::move(val));
+		return data()[m_size++];
+	}
+
+	new (&data()[m_size]) T(std::forward<Args>(args)...);
+	return data()[m_size++];
+}
+
+template <typename T, i32 N>
+T& SmallArray<T, N>::back()
+{
+	return data()[m_size-1];
+}
+
+template <typename T, i32 N>
+void* SmallArray<T, N>::push_back_uninit()
+{
+	if (m_size == m_capacity)
+		grow();
+
+	return &data()[m_size++];
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::resize(i32 new_size)
+{
+	if (new_size > m_capacity)
+	{
+		reserve(new_size);
+	}
+
+	T* items = data();
+	if (new_size > m_size)
+	{
+		for (i32 i = m_size; i < new_size; ++i)
+		{
+			new (&items[i]) T();
+		}
+	}
+	else if (new_size < m_size)
+	{
+		for (i32 i = new_size; i < m_size; ++i)
+		{
+			items[i].~T();
+		}
+	}
+
+	m_size = new_size;
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::resize_uninit(i32 new_size)
+{
+	if (new_size > m_capacity)
+	{
+		reserve(new_size);
+	}
+
+	T* items = data();
+	for (i32 i = new_size; i < m_size; ++i)
+	{
+		items[i].~T();
+	}
+
+	m_size = new_size;
+}
+
+// Spilling copies the inline elements out once, after that growth works like Array's.
+template <typename T, i32 N>
+void SmallArray<T, N>::reserve(i32 new_capacity)
+{
+	if (new_capacity <= m_capacity)
+		return;
+
+	T* new_data = nullptr;
+	if (!is_inline() && is_trivially_relocatable<T>::value)
+	{
+		new_data = (T*)m_allocator.try_expand(m_storage.heap, sizeof(T) * m_capacity, sizeof(T) * new_capacity);
+	}
+
+	if (!new_data)
+	{
+		new_data = (T*)m_allocator.alloc(sizeof(T) * new_capacity);
+
+		if (m_size > 0)
+		{
+			relocate(new_data, data(), m_size);
+			m_allocator.note_copy(new_data, sizeof(T) * m_size);
+		}
+
+		free_heap();
+	}
+
+	m_storage.heap = new_data;
+	m_capacity = new_capacity;
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::shrink_to_fit()
+{
+	if (is_inline() || m_size == m_capacity)
+		return;
+
+	T* old_data = m_storage.heap;
+	const i32 old_capacity = m_capacity;
+
+	if (m_size <= N)
+	{
+		relocate((T*)m_storage.inline_bytes, old_data, m_size);
+		m_capacity = N;
+	}
+	else
+	{
+		T* new_data = (T*)m_allocator.alloc(sizeof(T) * m_size);
+		relocate(new_data, old_data, m_size);
+		m_allocator.note_copy(new_data, sizeof(T) * m_size);
+		m_storage.heap = new_data;
+		m_capacity = m_size;
+	}
+
+	m_allocator.free(old_data, sizeof(T) * old_capacity);
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::clear()
+{
+	T* items = data();
+	for (i32 i = 0; i < m_size; ++i)
+	{
+		items[i].~T();
+	}
+
+	m_size = 0;
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::swap(SmallArray& r)
+{
+	if (!is_trivially_relocatable<T>::value)
+	{
+		SmallArray tmp(std::move(*this));
+		*this = std::move(r);
+		r = std::move(tmp);
+		return;
+	}
+
+	Storage storage;
+	memcpy((void*)&storage, &m_storage, sizeof(Storage));
+	memcpy((void*)&m_storage, &r.m_storage, sizeof(Storage));
+	memcpy((void*)&r.m_storage, &storage, sizeof(Storage));
+
+	i32 size = m_size;
+	i32 capacity = m_capacity;
+
+	m_size = r.m_size;
+	m_capacity = r.m_capacity;
+
+	r.m_size = size;
+	r.m_capacity = capacity;
+}
+
+template <typename T, i32 N>
+T& SmallArray<T, N>::operator[](i32 i)
+{
+	return data()[i];
+}
+
+template <typename T, i32 N>
+const T& SmallArray<T, N>::operator[](i32 i) const
+{
+	return data()[i];
+}
+
+template <typename T, i32 N>
+T* SmallArray<T, N>::begin()
+{
+	return data();
+}
+
+template <typename T, i32 N>
+T* SmallArray<T, N>::end()
+{
+	return data() + m_size;
+}
+
+template <typename T, i32 N>
+const T* SmallArray<T, N>::begin() const
+{
+	return data();
+}
+
+template <typename T, i32 N>
+const T* SmallArray<T, N>::end() const
+{
+	return data() + m_size;
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::grow()
+{
+	reserve(m_capacity * 2);
+}
+
+template <typename T, i32 N>
+void SmallArray<T, N>::free_heap()
+{
+	if (!is_inline())
+	{
+		m_allocator.free(m_storage.heap, sizeof(T) * m_capacity);
+	}
+}
+
+// Moves r's contents into this empty array with no heap buffer of its own, r is left empty and inline.
+template <typename T, i32 N>
+void SmallArray<T, N>::take(SmallArray& r)
+{
+	if (r.is_inline())
+	{
+		relocate((T*)m_storage.inline_bytes, (T*)r.m_storage.inline_bytes, r.m_size);
+	}
+	else
+	{
+		m_storage.heap = r.m_storage.heap;
+	}
+
+	m_size = r.m_size;
+	m_capacity = r.m_capacity;
+	r.m_size = 0;
+	r.m_capacity = N;
+}
+
+// Old elements are destroyed, by the move or by simply dropping their bytes.
+template <typename T, i32 N>
+void SmallArray<T, N>::relocate(T* to, T* from, i32 count)
+{
+	if (is_trivially_relocatable<T>::value)
+	{
+		memcpy((void*)to, from, sizeof(T) * count);
+		return;
+	}
+
+	for (i32 i = 0; i < count; ++i)
+	{
+		new (&to[i]) T(std::move(from[i]));
+		from[i].~T();
+	}
+}
+
+// Relocates with the object only if its inline elements do.
+template<typename T, i32 N>
+struct is_trivially_relocatable<SmallArray<T, N>> : is_trivially_relocatable<T> {};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "Epoch.h"
+#include "SwissTable.h"
+
+// Read-copy-update wrapper for read mostly tables. Readers look up in the published version
+// without locks or shared writes, a writer copies that version, changes the copy and publishes
+// it with one pointer swap. Replaced versions are freed once no reader can still be inside them.
+// Every update copies the whole table, so this pays off only when updates are rare.
+template<typename K, typename V, typename Hasher = WyHash, typename Eq = KeyEqual>
+class SnapshotSwissTable
+{
+public:
+	using Table = SwissTable<K, V, Hasher, Eq>;
+	using Lookup = typename SwissKeyTraits<K>::Lookup;
+
+	explicit SnapshotSwissTable(u32 initialCapacity = 16);
+	SnapshotSwissTable(Allocator& allocator, u32 initialCapacity = 16);
+	// No reader may be inside the table any more.
+	~SnapshotSwissTable();
+
+	SnapshotSwissTable(const SnapshotSwissTable&) = delete;
+	SnapshotSwissTable& operator=(const SnapshotSwissTable&) = delete;
+
+	// Copies the value into out, returns false when the key is missing.
+	bool find(const Lookup& key, V& out) const;
+
+	// Calls fn(const Table&) on the published version, which stays alive and unchanged until fn
+	// returns. Pointers into it must not escape fn.
+	template<typename Fn>
+	auto read(Fn&& fn) const;
+
+	// Calls fn(Table&) on a private copy of the published version and publishes the result.
+	// Writers are serialized, batch several changes into one update where possible.
+	template<typename Fn>
+	void update(Fn&& fn);
+
+	void insert_or_assign(const Lookup& key, const V& value);
+
+	bool erase(const Lookup& key);
+
+	// Frees retired versions no reader can see, returns how many are still waiting.
+	u32 reclaim();
+
+private:
+	struct Retired
+	{
+		Table* table;
+		u64 epoch;
+	};
+
+	Table* create(const Table& from);
+	void destroy(Table* table);
+	u32 reclaim_locked();
+
+private:
+	Allocator& m_allocator;
+	std::atomic<Table*> m_current;
+	std::mutex m_writeLock;
+	Array<Retired> m_retired;
+};
+
+template <typename K, typename V, typename Hasher, typename Eq>
+SnapshotSwissTable<K, V, Hasher, Eq>::SnapshotSwissTable(u32 initialCapacity)
+	: SnapshotSwissTable(default_allocator(), initialCapacity)
+{
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+SnapshotSwissTable<K, V, Hasher, Eq>::SnapshotSwissTable(Allocator& allocator, u32 initialCapacity)
+	: m_allocator(allocator)
+	, m_retired(allocator)
+{
+	Table* table = (Table*)m_allocator.alloc(sizeof(Table));
+	m_current.store(new (table) Table(allocator, initialCapacity), std::memory_order_release);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+SnapshotSwissTable<K, V, Hasher, Eq>::~SnapshotSwissTable()
+{
+	for (const Retired& r : m_retired)
+	{
+		destroy(r.table);
+	}
+	destroy(m_current.load(std::memory_order_acquire));
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+typename SnapshotSwissTable<K, V, Hasher, Eq>::Table* SnapshotSwissTable<K, V, Hasher, Eq>::create(const Table& from)
+{
+	Table* table = (Table*)m_allocator.alloc(sizeof(Table));
+	return new (table) Table(from);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+void SnapshotSwissTable<K, V, Hasher, Eq>::destroy(Table* table)
+{
+	table->~Table();
+	m_allocator.free(table, sizeof(Table));
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+bool SnapshotSwissTable<K, V, Hasher, Eq>::find(const Lookup& key, V& out) const
+{
+	EpochGuard guard;
+	const Table* table = m_current.load(std::memory_order_acquire);
+	const V* value = table->find(key);
+	if (value)
+		out = *value;
+	return value != nullptr;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+template <typename Fn>
+auto SnapshotSwissTable<K, V, Hasher, Eq>::read(Fn&& fn) const
+{
+	EpochGuard guard;
+	const Table* table = m_current.load(std::memory_order_acquire);
+	return fn(*table);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+template <typename Fn>
+void SnapshotSwissTable<K, V, Hasher, Eq>::update(Fn&& fn)
+{
+	std::lock_guard<std::mutex> lock(m_writeLock);
+
+	// Only writers replace the version and they hold the lock, no guard needed to copy it.
+	Table* next = create(*m_current.load(std::memory_order_relaxed));
+	fn(*next);
+
+	Table* previous = m_current.exchange(next, std::memory_order_acq_rel);
+	m_retired.push_back(Retired{previous, epoch_advance()});
+	reclaim_locked();
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+void SnapshotSwissTable<K, V, Hasher, Eq>::insert_or_assign(const Lookup& key, const V& value)
+{
+	update([&](Table& table) { table.insert_or_assign(key, value); });
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+bool SnapshotSwissTable<K, V, Hasher, Eq>::erase(const Lookup& key)
+{
+	// Skip the copy when there is nothing to erase.
+	if (!read([&](const Table& table) { return table.find(key) != nullptr; }))
+		return false;
+
+	bool erased = false;
+	update([&](Table& table) { erased = table.erase(key); });
+	return erased;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SnapshotSwissTable<K, V, Hasher, Eq>::reclaim()
+{
+	std::lock_guard<std::mutex> lock(m_writeLock);
+	return reclaim_locked();
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SnapshotSwissTable<K, V, Hasher, Eq>::reclaim_locked()
+{
+	const u64 safe = epoch_safe();
+
+	i32 kept = 0;
+	for (i32 i = 0; i < m_retired.size(); ++i)
+	{
+		if (m_retired[i].epoch < safe)
+			destroy(m_retired[i].table);
+		else
+			m_retired[kept++] = m_retired[i];
+	}
+	m_retired.resize(kept);
+	return (u32)kept;
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "Array.h"
+
+// Every column starts on its own cache line.
+static constexpr u64 SOA_COLUMN_ALIGN = 64;
+
+// Contiguous view of one column, valid until the array grows.
+template<typename T>
+struct Column
+{
+	T* data;
+	i32 size;
+
+	T& operator[](i32 i) const { return data[i]; }
+	T* begin() const { return data; }
+	T* end() const { return data + size; }
+};
+
+// Array of records stored field by field, one column per entry in Fields. A scan over one field only
+// reads that column, and a plain loop over column<I>() is unit stride and vectorizes. All columns
+// share one allocation, so growth can not expand in place and copies every column with memcpy, fields
+// have to be trivially copyable. Rows are proxies, row.get<I>() reaches a field.
+template<typename... Fields>
+class SoaArray
+{
+	static_assert(sizeof...(Fields) > 0, "SoaArray needs at least one column");
+	static_assert((std::is_trivially_copyable<Fields>::value && ...), "Columns are copied with memcpy");
+	static_assert(((alignof(Fields) <= SOA_COLUMN_ALIGN) && ...), "Columns are cache line aligned");
+
+	static constexpr i32 COLUMNS = sizeof...(Fields);
+	static constexpr u64 FIELD_SIZES[COLUMNS] = {sizeof(Fields)...};
+	static constexpr u64 ROW_BYTES = (sizeof(Fields) + ...);
+
+public:
+	template<i32 I>
+	using Field = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+	class Row
+	{
+	public:
+		Row(SoaArray& array, i32 index) : m_array(array), m_index(index) {}
+
+		template<i32 I>
+		Field<I>& get() const { return m_array.template column_data<I>()[m_index]; }
+
+	private:
+		SoaArray& m_array;
+		i32 m_index;
+	};
+
+	class ConstRow
+	{
+	public:
+		ConstRow(const SoaArray& array, i32 index) : m_array(array), m_index(index) {}
+
+		template<i32 I>
+		const Field<I>& get() const { return m_array.template column_data<I>()[m_index]; }
+
+	private:
+		const SoaArray& m_array;
+		i32 m_index;
+	};
+
+	explicit SoaArray(Allocator& allocator);
+	~SoaArray();
+
+	// Deep copy on the same allocator.
+	SoaArray(const SoaArray& r);
+	// Takes r's block and allocator, r is left empty.
+	SoaArray(SoaArray&& r);
+
+	SoaArray& operator=(const SoaArray& r);
+	// Takes r's block when both use the same allocator, otherwise copies the columns over.
+	SoaArray& operator=(SoaArray&& r);
+
+	void push_back(const Fields&... values);
+	Row back();
+
+	// New rows are value initialized.
+	void resize(i32 new_size);
+	void reserve(i32 new_capacity);
+	// Drops unused capacity, an empty array gives its memory back.
+	void shrink_to_fit();
+
+	void clear();
+
+	// Exchanges contents, both arrays have to use the same allocator.
+	void swap(SoaArray& r);
+
+	Row operator[](i32 i);
+	ConstRow operator[](i32 i) const;
+
+	template<i32 I>
+	Column<Field<I>> column();
+	template<i32 I>
+	Column<const Field<I>> column() const;
+
+	i32 size() const { return m_size; }
+	i32 capacity() const { return m_capacity; }
+
+private:
+	void grow();
+	// Moves the rows into a block for new_capacity, 0 frees the block.
+	void reallocate(i32 new_capacity);
+	void release();
+	template<typename T>
+	void construct_rows(i32 column, i32 from, i32 to);
+
+	template<i32 I>
+	Field<I>* column_data() const { return (Field<I>*)m_columns[I]; }
+
+	static u64 column_bytes(i32 column, i32 capacity)
+	{
+		return (FIELD_SIZES[column] * capacity + SOA_COLUMN_ALIGN - 1) & ~(SOA_COLUMN_ALIGN - 1);
+	}
+
+	// Slack for aligning the first column, the allocator only promises 16 bytes.
+	static u64 block_bytes(i32 capacity)
+	{
+		u64 bytes = SOA_COLUMN_ALIGN;
+		for (i32 c = 0; c < COLUMNS; ++c)
+		{
+			bytes += column_bytes(c, capacity);
+		}
+		return bytes;
+	}
+
+private:
+	Allocator& m_allocator;
+
+	void* m_block = nullptr;
+	void* m_columns[COLUMNS] = {};
+	i32 m_size = 0;
+	i32 m_capacity = 0;
+};
+
+template <typename... Fields>
+SoaArray<Fields...>::SoaArray(Allocator& allocator)
+	: m_allocator(allocator)
+{
+
+}
+
+template <typename... Fields>
+SoaArray<Fields...>::~SoaArray()
+{
+	release();
+}
+
+template <typename... Fields>
+SoaArray<Fields...>::SoaArray(const SoaArray& r)
+	: m_allocator(r.m_allocator)
+{
+	*this = r;
+}
+
+template <typename... Fields>
+SoaArray<Fields...>::SoaArray(SoaArray&& r)
+	: m_allocator(r.m_allocator)
+{
+	swap(r);
+}
+
+template <typename... Fields>
+SoaArray<Fields...>& SoaArray<Fields...>::operator=(const SoaArray& r)
+{
+	if (this == &r)
+		return *this;
+
+	clear();
+	reserve(r.m_size);
+
+	for (i32 c = 0; c < COLUMNS; ++c)
+	{
+		if (r.m_size > 0)
+			memcpy(m_columns[c], r.m_columns[c], FIELD_SIZES[c] * r.m_size);
+	}
+
+	m_size = r.m_size;
+	return *this;
+}
+
+template <typename... Fields>
+SoaArray<Fields...>& SoaArray<Fields...>::operator=(SoaArray&& r)
+{
+	if (this == &r)
+		return *this;
+
+	if (&m_allocator != &r.m_allocator)
+	{
+		*this = (const SoaArray&)r;
+		r.release();
+		return *this;
+	}
+
+	release();
+	swap(r);
+	return *this;
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::push_back(const Fields&... values)
+{
+	if (m_size == m_capacity)
+		grow();
+
+	i32 c = 0;
+	(new (&((Fields*)m_columns[c++])[m_size]) Fields(values), ...);
+	++m_size;
+}
+
+template <typename... Fields>
+typename SoaArray<Fields...>::Row SoaArray<Fields...>::back()
+{
+	return Row(*this, m_size - 1);
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::resize(i32 new_size)
+{
+	if (new_size > m_capacity)
+	{
+		reserve(new_size);
+	}
+
+	if (new_size > m_size)
+	{
+		i32 c = 0;
+		(construct_rows<Fields>(c++, m_size, new_size), ...);
+	}
+
+	m_size = new_size;
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::reserve(i32 new_capacity)
+{
+	if (new_capacity <= m_capacity)
+		return;
+
+	reallocate(new_capacity);
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::shrink_to_fit()
+{
+	if (m_size == m_capacity)
+		return;
+
+	reallocate(m_size);
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::clear()
+{
+	m_size = 0;
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::swap(SoaArray& r)
+{
+	std::swap(m_block, r.m_block);
+	std::swap(m_columns, r.m_columns);
+	std::swap(m_size, r.m_size);
+	std::swap(m_capacity, r.m_capacity);
+}
+
+template <typename... Fields>
+typename SoaArray<Fields...>::Row SoaArray<Fields...>::operator[](i32 i)
+{
+	return Row(*this, i);
+}
+
+template <typename... Fields>
+typename SoaArray<Fields...>::ConstRow SoaArray<Fields...>::operator[](i32 i) const
+{
+	return ConstRow(*this, i);
+}
+
+template <typename... Fields>
+template <i32 I>
+Column<typename SoaArray<Fields...>::template Field<I>> SoaArray<Fields...>::column()
+{
+	return Column<Field<I>>{column_data<I>(), m_size};
+}
+
+template <typename... Fields>
+template <i32 I>
+Column<const typename SoaArray<Fields...>::template Field<I>> SoaArray<Fields...>::column() const
+{
+	return Column<const Field<I>>{column_data<I>(), m_size};
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::grow()
+{
+	i32 new_capacity = m_capacity ? m_capacity * 2 : 16;
+	reserve(new_capacity);
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::reallocate(i32 new_capacity)
+{
+	void* old_block = m_block;
+	const i32 old_capacity = m_capacity;
+
+	if (new_capacity == 0)
+	{
+		m_block = nullptr;
+		for (i32 c = 0; c < COLUMNS; ++c)
+		{
+			m_columns[c] = nullptr;
+		}
+	}
+	else
+	{
+		m_block = m_allocator.alloc(block_bytes(new_capacity));
+
+		u8* column = (u8*)(((u64)m_block + SOA_COLUMN_ALIGN - 1) & ~(SOA_COLUMN_ALIGN - 1));
+		for (i32 c = 0; c < COLUMNS; ++c)
+		{
+			if (m_size > 0)
+				memcpy(column, m_columns[c], FIELD_SIZES[c] * m_size);
+
+			m_columns[c] = column;
+			column += column_bytes(c, new_capacity);
+		}
+
+		if (m_size > 0)
+			m_allocator.note_copy(m_block, ROW_BYTES * m_size);
+	}
+
+	if (old_block)
+	{
+		m_allocator.free(old_block, block_bytes(old_capacity));
+	}
+
+	m_capacity = new_capacity;
+}
+
+template <typename... Fields>
+void SoaArray<Fields...>::release()
+{
+	if (m_block)
+	{
+		m_allocator.free(m_block, block_bytes(m_capacity));
+	}
+
+	m_block = nullptr;
+	for (i32 c = 0; c < COLUMNS; ++c)
+	{
+		m_columns[c] = nullptr;
+	}
+	m_size = 0;
+	m_capacity = 0;
+}
+
+template <typename... Fields>
+template <typename T>
+void SoaArray<Fields...>::construct_rows(i32 column, i32 from, i32 to)
+{
+	T* items = (T*)m_columns[column];
+	for (i32 i = from; i < to; ++i)
+	{
+		new (&items[i]) T();
+	}
+}
+
+// Its column pointers point into the block, not into the object.
+template<typename... Fields>
+struct is_trivially_relocatable<SoaArray<Fields...>> : std::true_type {};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstring>
+
+#include "Array.h"
+#include "Core.h"
+
+// Non owning characters plus length, what lookups into string keyed containers take.
+struct StringView
+{
+	StringView()
+		: data("")
+		, length(0)
+	{
+	}
+
+	StringView(const char* str)
+		: data(str)
+		, length(strlen(str))
+	{
+	}
+
+	StringView(const char* str, u64 len)
+		: data(str)
+		, length(len)
+	{
+	}
+
+	const char* data;
+	u64 length;
+};
+
+inline bool operator==(StringView a, StringView b)
+{
+	return a.length == b.length && memcmp(a.data, b.data, a.length) == 0;
+}
+
+inline bool operator!=(StringView a, StringView b)
+{
+	return !(a == b);
+}
+
+// Owned, null terminated copy of a string. Holds no pointers into itself, so it can be moved
+// with memcpy and used as a SwissTable key.
+class String
+{
+public:
+	explicit String(StringView str, Allocator& allocator = default_allocator());
+	~String();
+
+	String(const String& r);
+	String(String&& r);
+
+	String& operator=(const String& r);
+	String& operator=(String&& r);
+
+	const char* data() const { return m_data; }
+	u64 size() const { return m_length; }
+
+	operator StringView() const { return StringView(m_data, m_length); }
+
+private:
+	void assign(StringView str);
+	void release();
+
+private:
+	Allocator* m_allocator;
+	char* m_data;
+	u64 m_length;
+};
+
+template<>
+struct is_trivially_relocatable<String> : std::true_type {};
+
+inline String::String(StringView str, Allocator& allocator)
+	: m_allocator(&allocator)
+{
+	assign(str);
+}
+
+inline String::~String()
+{
+	release();
+}
+
+inline String::String(const String& r)
+	: m_allocator(r.m_allocator)
+{
+	assign(r);
+}
+
+inline String::String(String&& r)
+	: m_allocator(r.m_allocator)
+	, m_data(r.m_data)
+	, m_length(r.m_length)
+{
+	r.m_data = nullptr;
+	r.m_length = 0;
+}
+
+inline String& String::operator=(const String& r)
+{
+	if (this != &r)
+	{
+		release();
+		m_allocator = r.m_allocator;
+		assign(r);
+	}
+	return *this;
+}
+
+inline String& String::operator=(String&& r)
+{
+	if (this != &r)
+	{
+		release();
+		m_allocator = r.m_allocator;
+		m_data = r.m_data;
+		m_length = r.m_length;
+		r.m_data = nullptr;
+		r.m_length = 0;
+	}
+	return *this;
+}
+
+inline void String::assign(StringView str)
+{
+	m_length = str.length;
+	m_data = (char*)m_allocator->alloc(m_length + 1);
+	memcpy(m_data, str.data, m_length);
+	m_data[m_length] = '\0';
+}
+
+inline void String::release()
+{
+	if (m_data)
+	{
+		m_allocator->free(m_data, m_length + 1);
+		m_data = nullptr;
+	}
+}
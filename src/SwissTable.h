@@ -1,6 +1,23 @@
 #pragma once
 
-#include <malloc.h>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#include "Array.h"
+#include "String.h"
+#include "wyhash.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SWISS_SSE2 1
+#include <emmintrin.h>
+#else
+#define SWISS_SSE2 0
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
 
 using u8 = unsigned char;
 using u32 = unsigned int;
@@ -42,29 +59,276 @@ enum ControlByte : u8
 	DELETED = 0xFE,
 };
 
-inline void* st_alloc(u64 sz)
+inline u32 count_trailing_zeros(u32 x)
 {
-	return ::malloc(sz);
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return index;
+#else
+	return __builtin_ctz(x);
+#endif
 }
 
-inline void st_free(void* mem)
+// One bit per slot of a group, lowest slot first.
+struct BitMask
+{
+	u32 mask;
+
+	explicit operator bool() const { return mask != 0; }
+
+	u32 lowest() const { return count_trailing_zeros(mask); }
+
+	void clear_lowest() { mask &= mask - 1; }
+};
+
+// 16 control bytes probed together. Full slots hold the 7 bit tag (high bit clear),
+// EMPTY and DELETED both have the high bit set.
+struct Group
+{
+	static constexpr u32 WIDTH = 16;
+
+#if SWISS_SSE2
+	explicit Group(const u8* pos)
+		: ctrl(_mm_loadu_si128((const __m128i*)pos))
+	{
+	}
+
+	BitMask match(u8 tag) const
+	{
+		return BitMask{(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)tag), ctrl))};
+	}
+
+	BitMask match_empty() const
+	{
+		return BitMask{(u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)EMPTY), ctrl))};
+	}
+
+	BitMask match_empty_or_deleted() const
+	{
+		return BitMask{(u32)_mm_movemask_epi8(ctrl)};
+	}
+
+	__m128i ctrl;
+#else
+	static constexpr u64 LSBS = 0x0101010101010101ULL;
+	static constexpr u64 MSBS = 0x8080808080808080ULL;
+
+	explicit Group(const u8* pos)
+	{
+		memcpy(ctrl, pos, sizeof(ctrl));
+	}
+
+	// Packs the high bit of every byte into the low 8 bits.
+	static u32 pack(u64 msbs)
+	{
+		return (u32)(((msbs >> 7) * 0x0102040810204080ULL) >> 56);
+	}
+
+	static u32 combine(u64 lo, u64 hi)
+	{
+		return pack(lo) | (pack(hi) << 8);
+	}
+
+	// May report false positives after a real match, callers always compare the key.
+	static u64 match_word(u64 word, u8 tag)
+	{
+		u64 x = word ^ (LSBS * tag);
+		return (x - LSBS) & ~x & MSBS;
+	}
+
+	static u64 empty_word(u64 word)
+	{
+		return word & ~(word << 6) & MSBS;
+	}
+
+	BitMask match(u8 tag) const
+	{
+		return BitMask{combine(match_word(ctrl[0], tag), match_word(ctrl[1], tag))};
+	}
+
+	BitMask match_empty() const
+	{
+		return BitMask{combine(empty_word(ctrl[0]), empty_word(ctrl[1]))};
+	}
+
+	BitMask match_empty_or_deleted() const
+	{
+		return BitMask{combine(ctrl[0] & MSBS, ctrl[1] & MSBS)};
+	}
+
+	u64 ctrl[2];
+#endif
+
+	BitMask match_full() const
+	{
+		return BitMask{~match_empty_or_deleted().mask & 0xFFFF};
+	}
+};
+
+inline void st_prefetch(const void* p)
 {
-	::free(mem);
+#if SWISS_SSE2
+	_mm_prefetch((const char*)p, _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(p);
+#endif
 }
 
-template<typename T>
+// Default hash policy, mixes every key so strided or aligned keys spread over all groups.
+// Strings hash their bytes, so String keys and StringView lookups agree.
+struct WyHash
+{
+	u64 operator()(u64 key) const { return wyhash::hash(key); }
+	u64 operator()(StringView key) const { return wyhash::hash(key.data, key.length); }
+};
+
+// For callers whose keys are already well distributed hashes.
+struct IdentityHash
+{
+	u64 operator()(u64 key) const { return key; }
+};
+
+struct KeyEqual
+{
+	template<typename A, typename B>
+	bool operator()(const A& a, const B& b) const { return a == b; }
+};
+
+// Per key type policy. Lookup is what find, insert and erase take, an owned key type can name a
+// view so probing needs no allocation, the key is only constructed from it on insert.
+// STORE_HASH keeps the full hash in the entry, rehash reads it back instead of hashing the key
+// again and lookups compare it before calling Eq. construct builds the stored key on insert, keys
+// that own memory take it from the table's allocator.
+template<typename K>
+struct SwissKeyTraits
+{
+	using Lookup = K;
+	static constexpr bool STORE_HASH = !std::is_arithmetic<K>::value && !std::is_enum<K>::value && !std::is_pointer<K>::value;
+
+	static void construct(void* key, const Lookup& lookup, Allocator& /*allocator*/) { new (key) K(lookup); }
+};
+
+template<>
+struct SwissKeyTraits<String>
+{
+	using Lookup = StringView;
+	static constexpr bool STORE_HASH = true;
+
+	static void construct(void* key, const Lookup& lookup, Allocator& allocator) { new (key) String(lookup, allocator); }
+};
+
+template<typename K, typename V, bool StoreHash = SwissKeyTraits<K>::STORE_HASH>
+struct SwissEntry
+{
+	K key;
+	V value;
+};
+
+template<typename K, typename V>
+struct SwissEntry<K, V, true>
+{
+	K key;
+	V value;
+	u64 hash;
+};
+
+template<typename K, typename V, typename Hasher = WyHash, typename Eq = KeyEqual>
 class SwissTable
 {
-	struct Entry
-	{
-		u64 key;
-		T value;
-	};
+	using Entry = SwissEntry<K, V>;
+	using Lookup = typename SwissKeyTraits<K>::Lookup;
+	constexpr static bool STORE_HASH = SwissKeyTraits<K>::STORE_HASH;
 
+	static_assert(alignof(Entry) <= 64, "Entries are placed on a cache line aligned block");
+	static_assert(is_trivially_relocatable<K>::value && is_trivially_relocatable<V>::value,
+		"Entries are moved with memcpy on rehash");
+
+	constexpr static u64 CACHE_LINE = 64;
 	constexpr static float MAX_LOAD_FACTOR = 0.7f;
+	constexpr static u32 NOT_FOUND = u32(-1);
+	constexpr static u32 PROBE_FURTHER = u32(-2);
+	// Keys in flight per pipeline stage of find_many and insert_many.
+	constexpr static u32 BATCH = 16;
+	// Old groups moved per insert or erase during an incremental rehash. Growth happens at 70% load
+	// into twice the capacity, so the old array drains long before the new one fills up.
+	constexpr static u32 MIGRATE_GROUPS = 1;
+
+	// Walks full slots a group at a time, empty and deleted runs are skipped 16 slots per step.
+	// During an incremental rehash the old array is walked first, then the current one.
+	template<typename E>
+	class Iterator
+	{
+	public:
+		Iterator(const u8* control, E* data, u32 groups, u32 group, const u8* nextControl = nullptr, E* nextData = nullptr, u32 nextGroups = 0)
+			: m_control(control)
+			, m_data(data)
+			, m_groups(groups)
+			, m_group(group)
+			, m_full{0}
+			, m_nextControl(nextControl)
+			, m_nextData(nextData)
+			, m_nextGroups(nextGroups)
+		{
+			if (m_group < m_groups)
+			{
+				m_full = Group(m_control + m_group * Group::WIDTH).match_full();
+				skip_empty_groups();
+			}
+		}
+
+		E& operator*() const { return m_data[m_group * Group::WIDTH + m_full.lowest()]; }
+		E* operator->() const { return &**this; }
+
+		Iterator& operator++()
+		{
+			m_full.clear_lowest();
+			skip_empty_groups();
+			return *this;
+		}
+
+		bool operator==(const Iterator& r) const { return m_group == r.m_group && m_full.mask == r.m_full.mask; }
+		bool operator!=(const Iterator& r) const { return !(*this == r); }
+
+	private:
+		void skip_empty_groups()
+		{
+			for (;;)
+			{
+				while (!m_full && ++m_group < m_groups)
+				{
+					m_full = Group(m_control + m_group * Group::WIDTH).match_full();
+				}
+
+				if (m_full || !m_nextControl)
+					return;
+
+				m_control = m_nextControl;
+				m_data = m_nextData;
+				m_groups = m_nextGroups;
+				m_group = 0;
+				m_full = Group(m_control).match_full();
+				m_nextControl = nullptr;
+			}
+		}
+
+		const u8* m_control;
+		E* m_data;
+		u32 m_groups;
+		u32 m_group;
+		BitMask m_full;
+		const u8* m_nextControl;
+		E* m_nextData;
+		u32 m_nextGroups;
+	};
 
 public:
+	using iterator = Iterator<Entry>;
+	using const_iterator = Iterator<const Entry>;
+
 	explicit SwissTable(u32 initialCapacity = 16);
+	explicit SwissTable(Allocator& allocator, u32 initialCapacity = 16);
+	~SwissTable();
 
 	SwissTable(const SwissTable& r);
 	SwissTable(SwissTable&& r);
@@ -72,265 +336,929 @@ public:
 	SwissTable& operator=(const SwissTable& r);
 	SwissTable& operator=(SwissTable&& r);
 
-	void insert(u64 key, const T& value);
-	T* insert_uninit(u64 key);
+	void insert(const Lookup& key, const V& value);
+	V* insert_uninit(const Lookup& key);
+
+	void insert_or_assign(const Lookup& key, const V& value);
+
+	V* find(const Lookup& key);
+	const V* find(const Lookup& key) const;
+
+	// Resolves n keys, out[i] is the value of keys[i] or nullptr. Hashes a batch first and prefetches
+	// its control groups and first candidate slots so the cache misses of independent keys overlap.
+	void find_many(const Lookup* keys, u32 n, V** out);
+
+	// Inserts keys[i] -> values[i], existing keys are left as they are. Grows once up front.
+	void insert_many(const Lookup* keys, const V* values, u32 n);
 
-	void insert_or_assign(u64 key, const T& value);
+	// Makes room for count entries without further rehashing.
+	void reserve(u32 count);
 
-	T* find(u64 key);
+	// Returns false when the key was not present.
+	bool erase(const Lookup& key);
 
-	void erase(u64 key);
+	// Growth keeps the old allocation and moves MIGRATE_GROUPS of its groups on every insert and erase
+	// instead of rehashing everything inside one insert. Lookups check both arrays until it is drained.
+	// Off by default, turning it off finishes a rehash in progress.
+	void set_incremental_rehash(bool enabled);
+
+	bool rehashing() const { return oldControl != nullptr; }
+
+	iterator begin()
+	{
+		if (oldControl)
+			return iterator(oldControl, oldData, oldCapacity / Group::WIDTH, 0, control, data, capacity / Group::WIDTH);
+		return iterator(control, data, capacity / Group::WIDTH, 0);
+	}
+
+	iterator end() { return iterator(control, data, capacity / Group::WIDTH, capacity / Group::WIDTH); }
+
+	const_iterator begin() const
+	{
+		if (oldControl)
+			return const_iterator(oldControl, oldData, oldCapacity / Group::WIDTH, 0, control, data, capacity / Group::WIDTH);
+		return const_iterator(control, data, capacity / Group::WIDTH, 0);
+	}
+
+	const_iterator end() const { return const_iterator(control, data, capacity / Group::WIDTH, capacity / Group::WIDTH); }
+
+	// Calls fn(key, value) for every entry.
+	template<typename Fn>
+	void for_each(Fn&& fn);
+	template<typename Fn>
+	void for_each(Fn&& fn) const;
+
+	// Number of groups visited to reach key in the current array, for measuring clustering.
+	u32 probe_length(const Lookup& key) const;
 
 private:
+	static u64 data_offset(u32 capacity);
+	static u64 storage_size(u32 capacity);
+
 	void init(u32 newCapacity);
 
-	u32 hash(u64 key) const;
+	void copy_from(const SwissTable& r);
+
+	void release();
 
-	u32 probe(u32 index, u32 step) const;
+	u64 hash(const Lookup& key) const;
 
-	u32 find_slot(u64 key) const;
+	u64 entry_hash(const Entry& e) const;
+
+	bool matches(const Entry& e, const Lookup& key, u64 hash) const;
+
+	u32 start_group(u64 hash) const;
+
+	u8 tag(u64 hash) const;
+
+	u32 probe(u32 group, u32 step) const;
+
+	u32 find_slot(const Lookup& key, u64 hash) const;
+
+	u32 find_slot(const u8* ctrl, const Entry* entries, u32 groupMask, const Lookup& key, u64 hash) const;
+
+	// Slot of key in the old array during an incremental rehash.
+	u32 find_old_slot(const Lookup& key, u64 hash) const;
+
+	u32 find_insert_slot(u64 hash) const;
+
+	u32 find_or_prepare_insert(const Lookup& key, bool* found);
+
+	u32 prepare_insert(const Lookup& key, u64 hash, bool* found);
 
 	void rehash(u32 newCapacity);
 
+	// Moves one entry out of the old array and marks its old slot DELETED so it is not found twice.
+	u32 relocate_old(u32 oldIndex, u64 hash);
+
+	// Moves the next groups of the old array, frees it once everything has been moved.
+	void migrate(u32 groups);
+
+	void free_old();
+
+	void drop_deleted();
+
+	Allocator* allocator;
+	// Control bytes and entries share this one allocation, both start on a cache line.
+	u8* memory;
+
+	// Previous allocation while an incremental rehash drains it, groups below migrated are done.
+	// size counts the entries of both arrays.
+	u8* oldMemory;
+	u8* oldControl;
+	Entry* oldData;
+	u32 oldCapacity;
+	u32 migrated;
+	bool incremental;
+
 public:
 	u8* control;
 	Entry* data;
 	u32 size;
+	u32 deleted;
 	u32 capacity;
 };
 
-template <typename T>
-SwissTable<T>::SwissTable(u32 initialCapacity)
+template <typename K, typename V, typename Hasher, typename Eq>
+SwissTable<K, V, Hasher, Eq>::SwissTable(u32 initialCapacity)
+	: SwissTable(default_allocator(), initialCapacity)
 {
-	init(power_of_2(initialCapacity));
 }
 
-template <typename T>
-SwissTable<T>::SwissTable(const SwissTable& r)
+template <typename K, typename V, typename Hasher, typename Eq>
+SwissTable<K, V, Hasher, Eq>::SwissTable(Allocator& allocator, u32 initialCapacity)
+	: allocator(&allocator)
+	, memory(nullptr)
+	, oldMemory(nullptr)
+	, oldControl(nullptr)
+	, oldData(nullptr)
+	, oldCapacity(0)
+	, migrated(0)
+	, incremental(false)
 {
-	control = (u8*)st_alloc(r.capacity * sizeof(u8));
-	data = (Entry*)st_alloc(r.capacity * sizeof(Entry));
+	init(power_of_2(initialCapacity < Group::WIDTH ? Group::WIDTH : initialCapacity));
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+SwissTable<K, V, Hasher, Eq>::~SwissTable()
+{
+	release();
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+SwissTable<K, V, Hasher, Eq>::SwissTable(const SwissTable& r)
+	: allocator(r.allocator)
+	, memory(nullptr)
+	, oldMemory(nullptr)
+	, oldControl(nullptr)
+	, oldData(nullptr)
+	, oldCapacity(0)
+	, migrated(0)
+	, incremental(r.incremental)
+{
+	copy_from(r);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+SwissTable<K, V, Hasher, Eq>::SwissTable(SwissTable&& r)
+{
+	allocator = r.allocator;
+	memory = r.memory;
+	data = r.data;
+	control = r.control;
 	capacity = r.capacity;
 	size = r.size;
+	deleted = r.deleted;
+	oldMemory = r.oldMemory;
+	oldControl = r.oldControl;
+	oldData = r.oldData;
+	oldCapacity = r.oldCapacity;
+	migrated = r.migrated;
+	incremental = r.incremental;
+
+	r.memory = nullptr;
+	r.control = nullptr;
+	r.data = nullptr;
+	r.size = 0;
+	r.deleted = 0;
+	r.capacity = 0;
+	r.oldMemory = nullptr;
+	r.oldControl = nullptr;
+	r.oldData = nullptr;
+	r.oldCapacity = 0;
+	r.migrated = 0;
+}
 
-	for (u32 i = 0; i < capacity; ++i)
+template <typename K, typename V, typename Hasher, typename Eq>
+SwissTable<K, V, Hasher, Eq>& SwissTable<K, V, Hasher, Eq>::operator=(const SwissTable& r)
+{
+	if (this != &r)
 	{
-		control[i] = r.control[i];
-		data[i] = r.data[i];
+		release();
+		incremental = r.incremental;
+		copy_from(r);
 	}
+
+	return *this;
 }
 
-template <typename T>
-SwissTable<T>::SwissTable(SwissTable&& r)
+template <typename K, typename V, typename Hasher, typename Eq>
+SwissTable<K, V, Hasher, Eq>& SwissTable<K, V, Hasher, Eq>::operator=(SwissTable&& r)
 {
 	if (this != &r)
 	{
+		release();
+
+		allocator = r.allocator;
+		memory = r.memory;
 		data = r.data;
 		control = r.control;
 		capacity = r.capacity;
 		size = r.size;
-
-
+		deleted = r.deleted;
+		oldMemory = r.oldMemory;
+		oldControl = r.oldControl;
+		oldData = r.oldData;
+		oldCapacity = r.oldCapacity;
+		migrated = r.migrated;
+		incremental = r.incremental;
+
+		r.memory = nullptr;
 		r.control = nullptr;
 		r.data = nullptr;
 		r.size = 0;
+		r.deleted = 0;
 		r.capacity = 0;
+		r.oldMemory = nullptr;
+		r.oldControl = nullptr;
+		r.oldData = nullptr;
+		r.oldCapacity = 0;
+		r.migrated = 0;
 	}
+
+	return *this;
 }
 
-template <typename T>
-SwissTable<T>& SwissTable<T>::operator=(const SwissTable& r)
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::insert(const Lookup& key, const V& value)
 {
-	if (this != &r)
+	bool found;
+	u32 index = find_or_prepare_insert(key, &found);
+
+	if (!found)
 	{
-		// todo free
-		capacity = r.capacity;
-		size = r.size;
+		new (&data[index].value) V(value);
+	}
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+V* SwissTable<K, V, Hasher, Eq>::insert_uninit(const Lookup& key)
+{
+	bool found;
+	u32 index = find_or_prepare_insert(key, &found);
+
+	if (!found)
+	{
+		return &data[index].value;
+	}
+
+	return nullptr;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::insert_or_assign(const Lookup& key, const V& value)
+{
+	bool found;
+	u32 index = find_or_prepare_insert(key, &found);
+
+	if (found)
+		data[index].value = value;
+	else
+		new (&data[index].value) V(value);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+V* SwissTable<K, V, Hasher, Eq>::find(const Lookup& key)
+{
+	const u64 h = hash(key);
+	u32 index = find_slot(key, h);
+
+	if (index != NOT_FOUND)
+	{
+		return &data[index].value;
+	}
+
+	if (oldControl && (index = find_old_slot(key, h)) != NOT_FOUND)
+	{
+		return &oldData[index].value;
+	}
 
+	return nullptr;
+}
 
-		control = (u8*)st_alloc(capacity * sizeof(u8));
-		memset(control, EMPTY, capacity);
-		data = (Entry*)st_alloc(capacity * sizeof(Entry));
-		memset(data, 0, capacity * sizeof(Entry));
+template <typename K, typename V, typename Hasher, typename Eq>
+const V* SwissTable<K, V, Hasher, Eq>::find(const Lookup& key) const
+{
+	const u64 h = hash(key);
+	u32 index = find_slot(key, h);
 
+	if (index != NOT_FOUND)
+	{
+		return &data[index].value;
+	}
+
+	if (oldControl && (index = find_old_slot(key, h)) != NOT_FOUND)
+	{
+		return &oldData[index].value;
+	}
 
-		for (u32 i = 0; i < capacity; ++i)
+	return nullptr;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::find_many(const Lookup* keys, u32 n, V** out)
+{
+	u64 hashes[BATCH];
+	u32 candidates[BATCH];
+
+	if (!control)
+	{
+		for (u32 i = 0; i < n; ++i)
+		{
+			out[i] = nullptr;
+		}
+		return;
+	}
+
+	for (u32 base = 0; base < n; base += BATCH)
+	{
+		const u32 count = n - base < BATCH ? n - base : BATCH;
+
+		for (u32 i = 0; i < count; ++i)
 		{
-			if (r.control[i] != DELETED && r.control[i] != EMPTY)
+			hashes[i] = hash(keys[base + i]);
+			st_prefetch(control + start_group(hashes[i]) * Group::WIDTH);
+		}
+
+		for (u32 i = 0; i < count; ++i)
+		{
+			const u32 group = start_group(hashes[i]);
+			Group g(control + group * Group::WIDTH);
+			BitMask match = g.match(tag(hashes[i]));
+
+			if (match)
+			{
+				candidates[i] = group * Group::WIDTH + match.lowest();
+				st_prefetch(&data[candidates[i]]);
+			}
+			else
 			{
-				control[i] = r.control[i];
-				data[i] = r.data[i];
+				candidates[i] = g.match_empty() ? NOT_FOUND : PROBE_FURTHER;
 			}
 		}
-	}
 
-	return *this;
+		for (u32 i = 0; i < count; ++i)
+		{
+			const Lookup& key = keys[base + i];
+			u32 index = candidates[i];
+
+			// Second candidates and longer probes take the scalar path, their groups are cached by now.
+			if (index == PROBE_FURTHER || (index != NOT_FOUND && !matches(data[index], key, hashes[i])))
+				index = find_slot(key, hashes[i]);
+
+			if (index != NOT_FOUND)
+				out[base + i] = &data[index].value;
+			else if (oldControl && (index = find_old_slot(key, hashes[i])) != NOT_FOUND)
+				out[base + i] = &oldData[index].value;
+			else
+				out[base + i] = nullptr;
+		}
+	}
 }
 
-template <typename T>
-SwissTable<T>& SwissTable<T>::operator=(SwissTable&& r)
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::insert_many(const Lookup* keys, const V* values, u32 n)
 {
-	if (this != &r)
+	reserve(size + n);
+
+	u64 hashes[BATCH];
+
+	for (u32 base = 0; base < n; base += BATCH)
 	{
+		const u32 count = n - base < BATCH ? n - base : BATCH;
 
-		data = r.data;
-		control = r.control;
-		capacity = r.capacity;
-		size = r.size;
+		if (oldControl)
+			migrate(MIGRATE_GROUPS * count);
 
-		r.control = nullptr;
-		r.data = nullptr;
-		r.size = 0;
-		r.capacity = 0;
+		for (u32 i = 0; i < count; ++i)
+		{
+			hashes[i] = hash(keys[base + i]);
+			st_prefetch(control + start_group(hashes[i]) * Group::WIDTH);
+		}
+
+		// Prefetch the slot the key will most likely end up in, a matching tag or else the first free slot.
+		for (u32 i = 0; i < count; ++i)
+		{
+			const u32 group = start_group(hashes[i]);
+			Group g(control + group * Group::WIDTH);
+			BitMask slot = g.match(tag(hashes[i]));
+			slot = slot ? slot : g.match_empty_or_deleted();
+			if (slot)
+				st_prefetch(&data[group * Group::WIDTH + slot.lowest()]);
+		}
+
+		for (u32 i = 0; i < count; ++i)
+		{
+			bool found;
+			u32 index = prepare_insert(keys[base + i], hashes[i], &found);
+
+			if (!found)
+			{
+				new (&data[index].value) V(values[base + i]);
+			}
+		}
 	}
+}
 
-	return *this;
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::reserve(u32 count)
+{
+	if (count + deleted < capacity * MAX_LOAD_FACTOR)
+		return;
+
+	u32 newCapacity = capacity < Group::WIDTH ? Group::WIDTH : capacity;
+	while (count >= newCapacity * MAX_LOAD_FACTOR)
+	{
+		newCapacity *= 2;
+	}
+
+	if (newCapacity == capacity)
+		drop_deleted();
+	else
+		rehash(newCapacity);
 }
 
-template <typename T>
-void SwissTable<T>::insert(u64 key, const T& value)
+template <typename K, typename V, typename Hasher, typename Eq>
+bool SwissTable<K, V, Hasher, Eq>::erase(const Lookup& key)
 {
-	if (size >= capacity * MAX_LOAD_FACTOR)
-		rehash(next_power_of_2(capacity));
+	const u64 h = hash(key);
+	u32 index = find_slot(key, h);
 
-	u32 index = find_slot(key);
+	if (oldControl)
+	{
+		if (index == NOT_FOUND && (index = find_old_slot(key, h)) != NOT_FOUND)
+		{
+			oldData[index].~Entry();
+			oldControl[index] = DELETED;
+			size--;
+			migrate(MIGRATE_GROUPS);
+			return true;
+		}
 
-	if (control[index] == EMPTY || control[index] == DELETED)
+		migrate(MIGRATE_GROUPS);
+	}
+
+	if (index != NOT_FOUND)
 	{
-		control[index] = key & 0x7F;
-		data[index] = { key, value };
-		size++;
+		data[index].~Entry();
+
+		// Lookups stop at the first group holding an EMPTY, so no probe sequence runs through
+		// a group that still has one and the slot can go straight back to EMPTY.
+		if (Group(control + index / Group::WIDTH * Group::WIDTH).match_empty())
+		{
+			control[index] = EMPTY;
+		}
+		else
+		{
+			control[index] = DELETED;
+			deleted++;
+		}
+		size--;
 	}
+
+	return index != NOT_FOUND;
 }
 
-template <typename T>
-T* SwissTable<T>::insert_uninit(u64 key)
+template <typename K, typename V, typename Hasher, typename Eq>
+u64 SwissTable<K, V, Hasher, Eq>::data_offset(u32 capacity)
 {
-	if (size >= capacity * MAX_LOAD_FACTOR)
-		rehash(next_power_of_2(capacity));
+	return (capacity + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+}
 
-	u32 index = find_slot(key);
+// One spare cache line so control can be aligned up inside whatever the allocator returns.
+template <typename K, typename V, typename Hasher, typename Eq>
+u64 SwissTable<K, V, Hasher, Eq>::storage_size(u32 capacity)
+{
+	return CACHE_LINE - 1 + data_offset(capacity) + (u64)capacity * sizeof(Entry);
+}
 
-	if (control[index] == EMPTY || control[index] == DELETED)
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::init(u32 newCapacity)
+{
+	size = 0;
+	deleted = 0;
+	capacity = newCapacity;
+	memory = (u8*)allocator->alloc(storage_size(capacity));
+	control = (u8*)(((u64)memory + CACHE_LINE - 1) & ~(CACHE_LINE - 1));
+	data = (Entry*)(control + data_offset(capacity));
+	memset(control, EMPTY, capacity);
+}
+
+// A table in the middle of an incremental rehash is copied compacted, into one array.
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::copy_from(const SwissTable& r)
+{
+	// A moved from r has nothing to copy, the copy still gets a whole group.
+	if (!r.memory)
 	{
-		control[index] = key & 0x7F;
-		data[index].key = key;
-		size++;
-		return &data[index].value;
+		init(Group::WIDTH);
+		return;
 	}
 
-	return nullptr;
+	init(r.capacity);
+	size = r.size;
+
+	if (r.oldControl)
+	{
+		for (const Entry& e : r)
+		{
+			const u64 h = entry_hash(e);
+			const u32 index = find_insert_slot(h);
+			control[index] = tag(h);
+			new (&data[index]) Entry(e);
+		}
+		return;
+	}
+
+	// Tombstones are copied as well, dropping them would cut probe sequences that run through them.
+	deleted = r.deleted;
+	memcpy(control, r.control, capacity);
+
+	for (u32 i = 0; i < capacity; ++i)
+	{
+		if (r.control[i] != DELETED && r.control[i] != EMPTY)
+		{
+			new (&data[i]) Entry(r.data[i]);
+		}
+	}
 }
 
-template <typename T>
-void SwissTable<T>::insert_or_assign(u64 key, const T& value)
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::release()
 {
-	if (size >= capacity * 0.7)
-		rehash(next_power_of_2(capacity));
+	if (!memory)
+		return;
+
+	if (!std::is_trivially_destructible<Entry>::value)
+	{
+		for (Entry& e : *this)
+		{
+			e.~Entry();
+		}
+	}
 
-	u32 index = find_slot(key);
+	allocator->free(memory, storage_size(capacity));
+	memory = nullptr;
+
+	if (oldMemory)
+		free_old();
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::set_incremental_rehash(bool enabled)
+{
+	incremental = enabled;
+
+	if (!enabled && oldControl)
+		migrate(oldCapacity / Group::WIDTH);
+}
 
-	if (control[index] == EMPTY || control[index] == DELETED)
+template <typename K, typename V, typename Hasher, typename Eq>
+template <typename Fn>
+void SwissTable<K, V, Hasher, Eq>::for_each(Fn&& fn)
+{
+	for (u32 group = 0; group < oldCapacity; group += Group::WIDTH)
 	{
-		control[index] = key & 0x7F;
-		data[index] = { key, value };
-		size++;
+		for (BitMask full = Group(oldControl + group).match_full(); full; full.clear_lowest())
+		{
+			Entry& e = oldData[group + full.lowest()];
+			fn(e.key, e.value);
+		}
 	}
-	else
+
+	for (u32 group = 0; group < capacity; group += Group::WIDTH)
 	{
-		data[index] = { key, value };
+		for (BitMask full = Group(control + group).match_full(); full; full.clear_lowest())
+		{
+			Entry& e = data[group + full.lowest()];
+			fn(e.key, e.value);
+		}
 	}
 }
 
-template <typename T>
-T* SwissTable<T>::find(u64 key)
+template <typename K, typename V, typename Hasher, typename Eq>
+template <typename Fn>
+void SwissTable<K, V, Hasher, Eq>::for_each(Fn&& fn) const
 {
-	u32 index = find_slot(key);
-	
-	if (control[index] != EMPTY && data[index].key == key)
+	for (u32 group = 0; group < oldCapacity; group += Group::WIDTH)
 	{
-		return &data[index].value;
+		for (BitMask full = Group(oldControl + group).match_full(); full; full.clear_lowest())
+		{
+			const Entry& e = oldData[group + full.lowest()];
+			fn(e.key, e.value);
+		}
 	}
 
-	return nullptr;
+	for (u32 group = 0; group < capacity; group += Group::WIDTH)
+	{
+		for (BitMask full = Group(control + group).match_full(); full; full.clear_lowest())
+		{
+			const Entry& e = data[group + full.lowest()];
+			fn(e.key, e.value);
+		}
+	}
 }
 
-template <typename T>
-void SwissTable<T>::erase(u64 key)
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::probe_length(const Lookup& key) const
 {
-	u32 index = find_slot(key);
-	if (control[index] != EMPTY && data[index].key == key)
+	const u64 h = hash(key);
+	u32 group = start_group(h);
+	u32 step = 0;
+
+	for (;;)
 	{
-		control[index] = DELETED;
-		size--;
+		Group g(control + group * Group::WIDTH);
+
+		for (BitMask candidates = g.match(tag(h)); candidates; candidates.clear_lowest())
+		{
+			if (matches(data[group * Group::WIDTH + candidates.lowest()], key, h))
+				return step + 1;
+		}
+
+		if (g.match_empty())
+			return step + 1;
+
+		group = probe(group, ++step);
 	}
 }
 
-template <typename T>
-void SwissTable<T>::init(u32 newCapacity)
+template <typename K, typename V, typename Hasher, typename Eq>
+u64 SwissTable<K, V, Hasher, Eq>::hash(const Lookup& key) const
 {
-	size = 0;
-	capacity = newCapacity;
-	control = (u8*)st_alloc(capacity * sizeof(u8));
-	memset(control, EMPTY, capacity);
-	data = (Entry*)st_alloc(capacity * sizeof(Entry));
-	memset(data, 0, capacity * sizeof(Entry));
+	return Hasher{}(key);
+}
 
+template <typename K, typename V, typename Hasher, typename Eq>
+u64 SwissTable<K, V, Hasher, Eq>::entry_hash(const Entry& e) const
+{
+	if constexpr (STORE_HASH)
+		return e.hash;
+	else
+		return hash(e.key);
 }
 
-template <typename T>
-u32 SwissTable<T>::hash(u64 key) const
+template <typename K, typename V, typename Hasher, typename Eq>
+bool SwissTable<K, V, Hasher, Eq>::matches(const Entry& e, const Lookup& key, u64 hash) const
 {
-	return key & (capacity - 1);
+	if constexpr (STORE_HASH)
+	{
+		if (e.hash != hash)
+			return false;
+	}
+	return Eq{}(e.key, key);
 }
 
-template <typename T>
-u32 SwissTable<T>::probe(u32 index, u32 step) const
+// The group comes from the high half of the hash and the tag from the low 7 bits,
+// so keys sharing a start group still get independent tags.
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::start_group(u64 hash) const
 {
-	return (index + step * step) & (capacity - 1);
+	return (u32)(hash >> 32) & (capacity / Group::WIDTH - 1);
 }
 
-template <typename T>
-u32 SwissTable<T>::find_slot(u64 key) const
+template <typename K, typename V, typename Hasher, typename Eq>
+u8 SwissTable<K, V, Hasher, Eq>::tag(u64 hash) const
 {
-	u32 index = hash(key);
-	u32 step = 1;
+	return hash & 0x7F;
+}
 
-	while (control[index] != EMPTY)
+// Triangular steps over whole groups, visits every group once when the group count is a power of 2.
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::probe(u32 group, u32 step) const
+{
+	return (group + step) & (capacity / Group::WIDTH - 1);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::find_slot(const Lookup& key, u64 hash) const
+{
+	// Moved from, there are no control bytes to load.
+	if (!control)
+		return NOT_FOUND;
+
+	return find_slot(control, data, capacity / Group::WIDTH - 1, key, hash);
+}
+
+// Same start group and probe sequence as start_group and probe, over any array of the table.
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::find_slot(const u8* ctrl, const Entry* entries, u32 groupMask, const Lookup& key, u64 hash) const
+{
+	const u8 keyTag = tag(hash);
+	u32 group = (u32)(hash >> 32) & groupMask;
+	u32 step = 0;
+
+	for (;;)
 	{
-		if (control[index] != DELETED && data[index].key == key)
-			return index;
+		Group g(ctrl + group * Group::WIDTH);
+
+		for (BitMask candidates = g.match(keyTag); candidates; candidates.clear_lowest())
+		{
+			u32 index = group * Group::WIDTH + candidates.lowest();
+			if (matches(entries[index], key, hash))
+				return index;
+		}
+
+		if (g.match_empty())
+			return NOT_FOUND;
 
-		index = probe(index, step++);
+		group = (group + ++step) & groupMask;
 	}
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::find_old_slot(const Lookup& key, u64 hash) const
+{
+	return find_slot(oldControl, oldData, oldCapacity / Group::WIDTH - 1, key, hash);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::find_insert_slot(u64 hash) const
+{
+	u32 group = start_group(hash);
+	u32 step = 0;
+
+	for (;;)
+	{
+		BitMask free = Group(control + group * Group::WIDTH).match_empty_or_deleted();
+		if (free)
+			return group * Group::WIDTH + free.lowest();
+
+		group = probe(group, ++step);
+	}
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::find_or_prepare_insert(const Lookup& key, bool* found)
+{
+	if (oldControl)
+		migrate(MIGRATE_GROUPS);
+
+	// Tombstones count towards the load so there is always an EMPTY to end a probe. When they make
+	// up more than half of it the table is cleaned in place instead of doubling.
+	if (size + deleted >= capacity * MAX_LOAD_FACTOR)
+	{
+		if (size * 2 < capacity * MAX_LOAD_FACTOR)
+			drop_deleted();
+		else
+			rehash(next_power_of_2(capacity));
+	}
+
+	return prepare_insert(key, hash(key), found);
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::prepare_insert(const Lookup& key, u64 h, bool* found)
+{
+	u32 index = find_slot(key, h);
+	*found = index != NOT_FOUND;
+
+	// A key still in the old array is moved over now, so the index always points into data.
+	if (index == NOT_FOUND && oldControl && (index = find_old_slot(key, h)) != NOT_FOUND)
+	{
+		*found = true;
+		return relocate_old(index, h);
+	}
+
+	if (index == NOT_FOUND)
+	{
+		index = find_insert_slot(h);
+		deleted -= control[index] == DELETED;
+		control[index] = tag(h);
+		SwissKeyTraits<K>::construct(&data[index].key, key, *allocator);
+		if constexpr (STORE_HASH)
+			data[index].hash = h;
+		size++;
+	}
+
 	return index;
 }
 
-template <typename T>
-void SwissTable<T>::rehash(u32 newCapacity)
+// Entries are relocated with memcpy, keys and values have to be trivially relocatable.
+// Without incremental rehashing the old array is drained right here.
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::rehash(u32 newCapacity)
 {
-	u8* oldControl = control;
-	Entry* oldData = data;
-	u32 oldCapacity = capacity;
+	// A moved from table has capacity 0 and no arrays, probing needs at least a whole group.
+	if (newCapacity < Group::WIDTH)
+		newCapacity = Group::WIDTH;
 
-	capacity = newCapacity;
+	if (!memory)
+	{
+		init(newCapacity);
+		return;
+	}
 
-	control = (u8*)st_alloc(capacity * sizeof(u8));
-	memset(control, EMPTY, capacity);
-	data = (Entry*)st_alloc(capacity * sizeof(Entry));
-	memset(data, 0, capacity * sizeof(Entry));
+	if (oldControl)
+		migrate(oldCapacity / Group::WIDTH);
+
+	const u32 count = size;
+	oldMemory = memory;
+	oldControl = control;
+	oldData = data;
+	oldCapacity = capacity;
+	migrated = 0;
+
+	init(newCapacity);
+	size = count;
 
+	if (incremental)
+		return;
+
+	// Drained in one pass, nothing else can see the old array so its slots need no marking.
 	for (u32 i = 0; i < oldCapacity; i++)
 	{
 		if (oldControl[i] != EMPTY && oldControl[i] != DELETED)
 		{
-			T* dst = insert_uninit(oldData[i].key);
-			memcpy(dst, &oldData[i].value, sizeof(T));
+			u32 index = find_insert_slot(entry_hash(oldData[i]));
+			control[index] = oldControl[i];
+			memcpy((void*)&data[index], &oldData[i], sizeof(Entry));
+		}
+	}
+
+	free_old();
+}
+
+// Keys are unique so entries go straight into the first free slot of their probe sequence.
+template <typename K, typename V, typename Hasher, typename Eq>
+u32 SwissTable<K, V, Hasher, Eq>::relocate_old(u32 oldIndex, u64 h)
+{
+	const u32 index = find_insert_slot(h);
+	deleted -= control[index] == DELETED;
+	control[index] = tag(h);
+	memcpy((void*)&data[index], &oldData[oldIndex], sizeof(Entry));
+	oldControl[oldIndex] = DELETED;
+	return index;
+}
+
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::migrate(u32 groups)
+{
+	const u32 end = oldCapacity - migrated > groups * Group::WIDTH ? migrated + groups * Group::WIDTH : oldCapacity;
+
+	for (; migrated < end; migrated += Group::WIDTH)
+	{
+		for (BitMask full = Group(oldControl + migrated).match_full(); full; full.clear_lowest())
+		{
+			const u32 i = migrated + full.lowest();
+			relocate_old(i, entry_hash(oldData[i]));
 		}
 	}
 
-	st_free(oldControl);
-	st_free(oldData);
+	if (migrated == oldCapacity)
+		free_old();
 }
 
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::free_old()
+{
+	allocator->free(oldMemory, storage_size(oldCapacity));
+	oldMemory = nullptr;
+	oldControl = nullptr;
+	oldData = nullptr;
+	oldCapacity = 0;
+	migrated = 0;
+}
 
+// Rehash into the same allocation. Tombstones become EMPTY and every live entry is marked DELETED,
+// then each marked entry moves to the first free slot of its probe sequence. Landing on another
+// marked entry swaps the two and the displaced one is processed next.
+template <typename K, typename V, typename Hasher, typename Eq>
+void SwissTable<K, V, Hasher, Eq>::drop_deleted()
+{
+	for (u32 i = 0; i < capacity; ++i)
+	{
+		control[i] = control[i] == DELETED ? EMPTY : (control[i] == EMPTY ? EMPTY : DELETED);
+	}
+
+	for (u32 i = 0; i < capacity; ++i)
+	{
+		if (control[i] != DELETED)
+			continue;
+
+		const u64 h = entry_hash(data[i]);
+		const u32 target = find_insert_slot(h);
+
+		if (target / Group::WIDTH == i / Group::WIDTH)
+		{
+			control[i] = tag(h);
+		}
+		else if (control[target] == EMPTY)
+		{
+			memcpy((void*)&data[target], &data[i], sizeof(Entry));
+			control[target] = tag(h);
+			control[i] = EMPTY;
+		}
+		else
+		{
+			alignas(Entry) u8 tmp[sizeof(Entry)];
+			memcpy(tmp, &data[target], sizeof(Entry));
+			memcpy((void*)&data[target], &data[i], sizeof(Entry));
+			memcpy((void*)&data[i], tmp, sizeof(Entry));
+			control[target] = tag(h);
+			--i;
+		}
+	}
+
+	deleted = 0;
+}
@@ -1,23 +1,135 @@
 #include "Timer.h"
 
+#if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#endif
 
-void timer_init(Timer* timer) { 
-	QueryPerformanceFrequency((LARGE_INTEGER*)&timer->freq); 
+#if defined(_M_X64) || defined(__x86_64__)
+#define TIMER_HAS_TSC 1
+#if !defined(_MSC_VER)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#else
+#define TIMER_HAS_TSC 0
+#endif
+
+static i64 os_frequency()
+{
+#if defined(_WIN32)
+	LARGE_INTEGER li;
+	QueryPerformanceFrequency(&li);
+	return li.QuadPart;
+#else
+	return 1000000000;
+#endif
 }
 
-void timer_start(Timer* timer)
+static i64 os_ticks()
 {
-    LARGE_INTEGER li;
+#if defined(_WIN32)
+	LARGE_INTEGER li;
 	QueryPerformanceCounter(&li);
-	timer->start = li.QuadPart;
+	return li.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+#if TIMER_HAS_TSC
+static bool has_invariant_tsc()
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 0x80000000);
+	if ((u32)regs[0] < 0x80000007)
+		return false;
+	__cpuid(regs, 0x80000007);
+	return (regs[3] & (1 << 8)) != 0;
+#else
+	u32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+	if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+		return false;
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return (edx & (1 << 8)) != 0;
+#endif
+}
+
+// Counts TSC ticks over ~20 ms of the OS clock.
+static i64 calibrate_tsc()
+{
+	const i64 osFreq = os_frequency();
+	const i64 osStart = os_ticks();
+	const i64 tscStart = __rdtsc();
+
+	i64 osNow;
+	do
+	{
+		osNow = os_ticks();
+	} while (osNow - osStart < osFreq / 50);
+
+	const i64 tscEnd = __rdtsc();
+	return (i64)((double)(tscEnd - tscStart) * osFreq / (osNow - osStart));
+}
+#endif
+
+struct TimerSource
+{
+	bool tsc;
+	i64 freq;
+};
+
+static const TimerSource& timer_source()
+{
+	static const TimerSource source = [] {
+#if TIMER_HAS_TSC
+		if (has_invariant_tsc())
+			return TimerSource{true, calibrate_tsc()};
+#endif
+		return TimerSource{false, os_frequency()};
+	}();
+	return source;
+}
+
+static i64 timer_ticks()
+{
+#if TIMER_HAS_TSC
+	if (timer_source().tsc)
+		return __rdtsc();
+#endif
+	return os_ticks();
+}
+
+void timer_init(Timer* timer)
+{
+	timer->start = 0;
+	timer->freq = timer_source().freq;
+}
+
+void timer_start(Timer* timer)
+{
+	timer->start = timer_ticks();
 }
 
 double timer_elapsed_ms(Timer* timer)
 {
-	LARGE_INTEGER li;
-	QueryPerformanceCounter(&li);
-	return (li.QuadPart - timer->start) * 1000.0 / timer->freq;
-}
\ No newline at end of file
+	return (timer_ticks() - timer->start) * 1000.0 / timer->freq;
+}
+
+const char* timer_backend()
+{
+	if (timer_source().tsc)
+		return "tsc";
+#if defined(_WIN32)
+	return "qpc";
+#else
+	return "clock_monotonic_raw";
+#endif
+}
@@ -8,8 +8,12 @@ struct Timer
     i64 freq;
 };
 
+// Picks the invariant TSC when the CPU has one (calibrated once against the OS clock),
+// otherwise QueryPerformanceCounter on Windows and CLOCK_MONOTONIC_RAW elsewhere.
 void timer_init(Timer* timer);
 
 void timer_start(Timer* timer);
 
-double timer_elapsed_ms(Timer* timer);
\ No newline at end of file
+double timer_elapsed_ms(Timer* timer);
+
+const char* timer_backend();
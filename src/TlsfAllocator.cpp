@@ -0,0 +1,449 @@
+#include "TlsfAllocator.h"
+
+#include <cstddef>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+struct TlsfBlock
+{
+	// Physically previous block, nullptr for the first block of a region.
+	TlsfBlock* prev_phys;
+	// Payload bytes, a multiple of 16. The low bit is set while the block is free.
+	u64 size;
+	// Only in the payload of free blocks.
+	TlsfBlock* next_free;
+	TlsfBlock* prev_free;
+};
+
+// Sits at the start of the block's data, the first heap block follows it 16 byte aligned. A zero
+// sized used block at the very end stops coalescing there.
+struct TlsfRegion
+{
+	TlsfRegion* prev;
+	TlsfRegion* next;
+};
+
+static constexpr u64 HEADER_SIZE = offsetof(TlsfBlock, next_free);
+static constexpr u64 MIN_PAYLOAD = sizeof(TlsfBlock) - HEADER_SIZE;
+static constexpr u64 FREE_BIT = 1;
+static constexpr u64 FIRST_OFFSET = ((offsetof(Block, data) + sizeof(TlsfRegion) + 15) & ~15ULL) - offsetof(Block, data);
+// Larger sizes get their own mapping, a quarter of a region keeps huge blocks from pinning regions.
+static constexpr u64 LARGE_SIZE = Block::BLOCK_SIZE / 4;
+
+static u32 highest_bit(u64 x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return index;
+#else
+	return 63 - __builtin_clzll(x);
+#endif
+}
+
+static u32 lowest_bit(u32 x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	_BitScanForward(&index, x);
+	return index;
+#else
+	return __builtin_ctz(x);
+#endif
+}
+
+static u64 adjust_size(u64 size)
+{
+	size = (size + 15) & ~15ULL;
+	return size < MIN_PAYLOAD ? MIN_PAYLOAD : size;
+}
+
+static u64 page_round(u64 size)
+{
+	return (size + Block::PAGE_SIZE - 1) & ~(u64)(Block::PAGE_SIZE - 1);
+}
+
+static void mapping_insert(u64 size, u32& fl, u32& sl)
+{
+	if (size < TLSF_SMALL_SIZE)
+	{
+		fl = 0;
+		sl = (u32)(size >> 4);
+	}
+	else
+	{
+		const u32 bit = highest_bit(size);
+		sl = (u32)(size >> (bit - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+		fl = bit - TLSF_FL_SHIFT + 1;
+	}
+}
+
+// Rounds up to the next list boundary, any block in that list or above fits without a search.
+static u64 round_for_search(u64 size)
+{
+	if (size >= TLSF_SMALL_SIZE)
+		size += (1ULL << (highest_bit(size) - TLSF_SL_LOG2)) - 1;
+	return size;
+}
+
+static u64 block_size(const TlsfBlock* block)
+{
+	return block->size & ~FREE_BIT;
+}
+
+static bool is_free(const TlsfBlock* block)
+{
+	return block->size & FREE_BIT;
+}
+
+static u8* payload(TlsfBlock* block)
+{
+	return (u8*)block + HEADER_SIZE;
+}
+
+static TlsfBlock* from_payload(void* data)
+{
+	return (TlsfBlock*)((u8*)data - HEADER_SIZE);
+}
+
+static TlsfBlock* next_phys(TlsfBlock* block)
+{
+	return (TlsfBlock*)(payload(block) + block_size(block));
+}
+
+static Block* region_block(TlsfRegion* region)
+{
+	return (Block*)((u8*)region - offsetof(Block, data));
+}
+
+TlsfAllocator::TlsfAllocator(const TlsfConfig& config)
+	: m_budget(config.budget)
+	, m_regions(nullptr)
+	, m_regionCount(0)
+	, m_flBitmap(0)
+	, m_refused(0)
+{
+	memset(m_slBitmap, 0, sizeof(m_slBitmap));
+	memset(m_free, 0, sizeof(m_free));
+}
+
+TlsfAllocator::~TlsfAllocator()
+{
+	Block* chain = nullptr;
+	for (TlsfRegion* region = m_regions; region; region = region->next)
+	{
+		Block* block = region_block(region);
+		block->header.prev = chain;
+		chain = block;
+	}
+
+	if (chain)
+		return_block(chain);
+}
+
+void* TlsfAllocator::alloc(u64 size)
+{
+	const u64 adjusted = adjust_size(size);
+	if (adjusted > LARGE_SIZE)
+	{
+		const u64 mapped = page_round(size);
+		if (!fits_budget(mapped))
+		{
+			++m_refused;
+			return nullptr;
+		}
+
+		void* data = m_large.alloc(size);
+		if (data)
+		{
+			m_stats.bytes_reserved += mapped;
+			on_alloc(size, mapped - size);
+		}
+		return data;
+	}
+
+	TlsfBlock* block = find_free(adjusted);
+	if (!block)
+	{
+		if (!add_region())
+		{
+			++m_refused;
+			return nullptr;
+		}
+		block = find_free(adjusted);
+	}
+
+	remove_free(block);
+	split(block, adjusted);
+	on_alloc(size, HEADER_SIZE + block_size(block) - size);
+	return payload(block);
+}
+
+void TlsfAllocator::free(void* data, u64 size)
+{
+	if (!data)
+		return;
+
+	++m_stats.frees;
+	m_stats.bytes_live -= size;
+
+	if (adjust_size(size) > LARGE_SIZE)
+	{
+		const u64 mapped = page_round(size);
+		m_large.free(data, size);
+		m_stats.bytes_reserved -= mapped;
+		m_stats.bytes_wasted -= mapped - size;
+		return;
+	}
+
+	TlsfBlock* block = from_payload(data);
+	m_stats.bytes_wasted -= HEADER_SIZE + block_size(block) - size;
+
+	TlsfBlock* prev = block->prev_phys;
+	if (prev && is_free(prev))
+	{
+		remove_free(prev);
+		prev->size += HEADER_SIZE + block_size(block);
+		block = prev;
+	}
+
+	TlsfBlock* next = next_phys(block);
+	if (is_free(next))
+	{
+		remove_free(next);
+		block->size += HEADER_SIZE + block_size(next);
+	}
+	next_phys(block)->prev_phys = block;
+
+	// The first block reaching the end marker is the whole region.
+	if (!block->prev_phys && next_phys(block)->size == 0 && m_regionCount > 1)
+	{
+		release_region((TlsfRegion*)((u8*)block - FIRST_OFFSET));
+		return;
+	}
+
+	insert_free(block);
+}
+
+void* TlsfAllocator::try_expand(void* data, u64 size, u64 newSize)
+{
+	if (adjust_size(size) > LARGE_SIZE)
+	{
+		const u64 grown = page_round(newSize) - page_round(size);
+		if (!fits_budget(grown))
+			return nullptr;
+
+		void* moved = m_large.try_expand(data, size, newSize);
+		if (moved)
+		{
+			m_stats.bytes_reserved += grown;
+			m_stats.bytes_wasted += page_round(newSize) - newSize - (page_round(size) - size);
+			++m_stats.expands;
+			m_stats.bytes_requested += newSize - size;
+			m_stats.bytes_live += newSize - size;
+			m_stats.bytes_peak = m_stats.bytes_live > m_stats.bytes_peak ? m_stats.bytes_live : m_stats.bytes_peak;
+		}
+		return moved;
+	}
+
+	const u64 wanted = adjust_size(newSize);
+	if (wanted > LARGE_SIZE)
+		return nullptr;
+
+	TlsfBlock* block = from_payload(data);
+	const u64 had = block_size(block);
+	if (wanted > had)
+	{
+		TlsfBlock* next = next_phys(block);
+		if (!is_free(next) || had + HEADER_SIZE + block_size(next) < wanted)
+			return nullptr;
+
+		remove_free(next);
+		block->size = had + HEADER_SIZE + block_size(next);
+		next_phys(block)->prev_phys = block;
+		split(block, wanted);
+	}
+
+	++m_stats.expands;
+	m_stats.bytes_requested += newSize - size;
+	m_stats.bytes_live += newSize - size;
+	m_stats.bytes_peak = m_stats.bytes_live > m_stats.bytes_peak ? m_stats.bytes_live : m_stats.bytes_peak;
+	m_stats.bytes_wasted += block_size(block) - newSize - (had - size);
+	return data;
+}
+
+void TlsfAllocator::note_copy(void* /*block*/, u64 bytes)
+{
+	m_stats.bytes_copied += bytes;
+}
+
+// Any block in the list size rounds up to fits, the bitmaps point at the first non empty one.
+TlsfBlock* TlsfAllocator::find_free(u64 size)
+{
+	u32 fl;
+	u32 sl;
+	mapping_insert(round_for_search(size), fl, sl);
+	if (fl >= TLSF_FL_COUNT)
+		return nullptr;
+
+	u32 slMap = m_slBitmap[fl] & (~0u << sl);
+	if (!slMap)
+	{
+		const u32 flMap = m_flBitmap & (~0u << (fl + 1));
+		if (!flMap)
+			return nullptr;
+
+		fl = lowest_bit(flMap);
+		slMap = m_slBitmap[fl];
+	}
+
+	return m_free[fl][lowest_bit(slMap)];
+}
+
+void TlsfAllocator::insert_free(TlsfBlock* block)
+{
+	u32 fl;
+	u32 sl;
+	mapping_insert(block_size(block), fl, sl);
+
+	TlsfBlock*& head = m_free[fl][sl];
+	block->size |= FREE_BIT;
+	block->prev_free = nullptr;
+	block->next_free = head;
+	if (head)
+		head->prev_free = block;
+	head = block;
+
+	m_flBitmap |= 1u << fl;
+	m_slBitmap[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::remove_free(TlsfBlock* block)
+{
+	u32 fl;
+	u32 sl;
+	mapping_insert(block_size(block), fl, sl);
+
+	if (block->next_free)
+		block->next_free->prev_free = block->prev_free;
+	if (block->prev_free)
+		block->prev_free->next_free = block->next_free;
+	else
+		m_free[fl][sl] = block->next_free;
+
+	if (!m_free[fl][sl])
+	{
+		m_slBitmap[fl] &= ~(1u << sl);
+		if (!m_slBitmap[fl])
+			m_flBitmap &= ~(1u << fl);
+	}
+
+	block->size &= ~FREE_BIT;
+}
+
+// Cuts a used block down to size, the rest becomes a free block when it can hold one. Its right
+// neighbour is never free, free blocks are always coalesced.
+void TlsfAllocator::split(TlsfBlock* block, u64 size)
+{
+	const u64 total = block_size(block);
+	if (total < size + HEADER_SIZE + MIN_PAYLOAD)
+		return;
+
+	TlsfBlock* rest = (TlsfBlock*)(payload(block) + size);
+	rest->prev_phys = block;
+	rest->size = total - size - HEADER_SIZE;
+	next_phys(rest)->prev_phys = rest;
+	block->size = size;
+	insert_free(rest);
+}
+
+bool TlsfAllocator::add_region()
+{
+	if (!fits_budget(sizeof(Block)))
+		return false;
+
+	Block* memory = get_block();
+	if (!memory)
+		return false;
+
+	TlsfRegion* region = (TlsfRegion*)memory->data;
+	region->prev = nullptr;
+	region->next = m_regions;
+	if (m_regions)
+		m_regions->prev = region;
+	m_regions = region;
+	++m_regionCount;
+	m_stats.bytes_reserved += sizeof(Block);
+
+	TlsfBlock* first = (TlsfBlock*)((u8*)region + FIRST_OFFSET);
+	TlsfBlock* end = (TlsfBlock*)((u8*)memory + sizeof(Block) - HEADER_SIZE);
+	first->prev_phys = nullptr;
+	first->size = (u8*)end - payload(first);
+	end->prev_phys = first;
+	end->size = 0;
+
+	insert_free(first);
+	return true;
+}
+
+void TlsfAllocator::release_region(TlsfRegion* region)
+{
+	if (region->prev)
+		region->prev->next = region->next;
+	else
+		m_regions = region->next;
+	if (region->next)
+		region->next->prev = region->prev;
+
+	--m_regionCount;
+	m_stats.bytes_reserved -= sizeof(Block);
+
+	Block* memory = region_block(region);
+	memory->header.prev = nullptr;
+	return_block(memory);
+}
+
+bool TlsfAllocator::fits_budget(u64 bytes) const
+{
+	return !m_budget || m_stats.bytes_reserved + bytes <= m_budget;
+}
+
+void TlsfAllocator::on_alloc(u64 size, u64 overhead)
+{
+	++m_stats.allocs;
+	m_stats.bytes_requested += size;
+	m_stats.bytes_live += size;
+	m_stats.bytes_peak = m_stats.bytes_live > m_stats.bytes_peak ? m_stats.bytes_live : m_stats.bytes_peak;
+	m_stats.bytes_wasted += overhead;
+}
+
+AllocatorStats TlsfAllocator::stats() const
+{
+	return m_stats;
+}
+
+TlsfHeapStats TlsfAllocator::heap_stats() const
+{
+	TlsfHeapStats stats = {};
+	stats.regions = m_regionCount;
+	stats.refused = m_refused;
+
+	for (u32 fl = 0; fl < TLSF_FL_COUNT; ++fl)
+	{
+		for (u32 sl = 0; sl < TLSF_SL_COUNT; ++sl)
+		{
+			for (const TlsfBlock* block = m_free[fl][sl]; block; block = block->next_free)
+			{
+				const u64 size = block_size(block);
+				++stats.free_blocks;
+				stats.free_bytes += size;
+				stats.largest_free = size > stats.largest_free ? size : stats.largest_free;
+			}
+		}
+	}
+
+	stats.fragmentation = stats.free_bytes ? 1.0 - (double)stats.largest_free / stats.free_bytes : 0.0;
+	return stats;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Array.h"
+#include "Core.h"
+#include "LargeAllocator.h"
+#include "ScratchAllocator.h"
+
+// First level lists split sizes by power of 2, each into 2^TLSF_SL_LOG2 second level lists. Sizes
+// below TLSF_SMALL_SIZE share the first list, in 16 byte steps.
+static constexpr u32 TLSF_SL_LOG2 = 4;
+static constexpr u32 TLSF_SL_COUNT = 1 << TLSF_SL_LOG2;
+static constexpr u32 TLSF_FL_SHIFT = TLSF_SL_LOG2 + 4;
+static constexpr u64 TLSF_SMALL_SIZE = 1ULL << TLSF_FL_SHIFT;
+// Enough first level lists for a free block spanning a whole region.
+static constexpr u32 TLSF_FL_COUNT = 25 - TLSF_FL_SHIFT + 1;
+
+struct TlsfConfig
+{
+	// Most bytes the allocator takes from the OS, regions and large mappings together. 0 is no limit.
+	u64 budget = 0;
+};
+
+struct TlsfHeapStats
+{
+	i32 regions;
+	u32 free_blocks;
+	u64 free_bytes;
+	// Largest allocation that fits without taking another region.
+	u64 largest_free;
+	// 1 - largest_free / free_bytes, 0 while all free space is one block.
+	double fragmentation;
+	// Allocations refused because the budget was reached.
+	u64 refused;
+};
+
+struct TlsfBlock;
+struct TlsfRegion;
+
+// Two level segregated fit over regions taken from the block pool. Finding a list is two bit scans,
+// freeing coalesces with both neighbours, so alloc and free are bounded no matter how fragmented the
+// heap is. Every block has a 16 byte header and is 16 byte aligned, try_expand grows into a free
+// neighbour. A region that becomes entirely free goes back to the pool unless it is the last one.
+// Sizes that do not fit a region get their own mapping. alloc returns nullptr once the budget would
+// be exceeded. Not thread safe.
+class TlsfAllocator : public Allocator
+{
+public:
+	explicit TlsfAllocator(const TlsfConfig& config = TlsfConfig());
+	~TlsfAllocator() override;
+
+	TlsfAllocator(const TlsfAllocator&) = delete;
+	TlsfAllocator& operator=(const TlsfAllocator&) = delete;
+
+	void* alloc(u64 size) override;
+	void free(void* block, u64 size) override;
+	void* try_expand(void* block, u64 size, u64 newSize) override;
+	void note_copy(void* block, u64 bytes) override;
+
+	// Reserved is regions plus large mappings, wasted the headers and rounding of live blocks.
+	AllocatorStats stats() const override;
+	// Walks the free lists.
+	TlsfHeapStats heap_stats() const;
+
+private:
+	TlsfBlock* find_free(u64 size);
+	void insert_free(TlsfBlock* block);
+	void remove_free(TlsfBlock* block);
+	void split(TlsfBlock* block, u64 size);
+	bool add_region();
+	void release_region(TlsfRegion* region);
+	bool fits_budget(u64 bytes) const;
+	void on_alloc(u64 size, u64 overhead);
+
+	u64 m_budget;
+	TlsfRegion* m_regions;
+	i32 m_regionCount;
+
+	u32 m_flBitmap;
+	u32 m_slBitmap[TLSF_FL_COUNT];
+	TlsfBlock* m_free[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+	LargeAllocator m_large;
+	AllocatorStats m_stats;
+	u64 m_refused;
+};
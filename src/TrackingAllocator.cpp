@@ -0,0 +1,191 @@
+#include "TrackingAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <initializer_list>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RETURN_ADDRESS() _ReturnAddress()
+#else
+#define RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+struct alignas(16) TrackingHeader
+{
+	u32 site;
+};
+
+static constexpr u64 HEADER_SIZE = sizeof(TrackingHeader);
+
+static TrackingHeader* tracking_header(void* block)
+{
+	return (TrackingHeader*)block - 1;
+}
+
+static void add_live(AllocatorStats& stats, u64 size)
+{
+	stats.bytes_live += size;
+	if (stats.bytes_live > stats.bytes_peak)
+		stats.bytes_peak = stats.bytes_live;
+}
+
+TrackingAllocator::TrackingAllocator(Allocator& inner)
+	: m_inner(inner)
+	, m_siteCount(1)
+{
+	memset((void*)m_sites, 0, sizeof(m_sites));
+}
+
+// Slot 0 is never probed, a zero address marks a free slot.
+u32 TrackingAllocator::find_site(const void* address)
+{
+	u32 i = (u32)(((u64)address * 0x9E3779B97F4A7C15ULL) >> 54) & (MAX_SITES - 1);
+	for (;;)
+	{
+		if (i != 0)
+		{
+			if (m_sites[i].address == address)
+				return i;
+			if (!m_sites[i].address)
+				break;
+		}
+		i = (i + 1) & (MAX_SITES - 1);
+	}
+
+	// Keeps a quarter of the table free so probes stay short.
+	if (m_siteCount >= MAX_SITES / 4 * 3)
+		return 0;
+
+	++m_siteCount;
+	m_sites[i].address = address;
+	return i;
+}
+
+void* TrackingAllocator::alloc(u64 size)
+{
+	const void* address = RETURN_ADDRESS();
+
+	u8* base = (u8*)m_inner.alloc(HEADER_SIZE + size);
+	if (!base)
+		return nullptr;
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	const u32 site = find_site(address);
+	for (AllocatorStats* stats : {&m_sites[site].stats, &m_totals})
+	{
+		++stats->allocs;
+		stats->bytes_requested += size;
+		add_live(*stats, size);
+	}
+
+	TrackingHeader* header = (TrackingHeader*)base;
+	header->site = site;
+	return header + 1;
+}
+
+void TrackingAllocator::free(void* block, u64 size)
+{
+	if (!block)
+		return;
+
+	TrackingHeader* header = tracking_header(block);
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		for (AllocatorStats* stats : {&m_sites[header->site].stats, &m_totals})
+		{
+			++stats->frees;
+			stats->bytes_live -= size;
+		}
+	}
+
+	m_inner.free(header, HEADER_SIZE + size);
+}
+
+void* TrackingAllocator::try_expand(void* block, u64 size, u64 newSize)
+{
+	TrackingHeader* moved = (TrackingHeader*)m_inner.try_expand(tracking_header(block), HEADER_SIZE + size, HEADER_SIZE + newSize);
+	if (!moved)
+		return nullptr;
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (AllocatorStats* stats : {&m_sites[moved->site].stats, &m_totals})
+	{
+		++stats->expands;
+		stats->bytes_requested += newSize - size;
+		add_live(*stats, newSize - size);
+	}
+	return moved + 1;
+}
+
+void TrackingAllocator::note_copy(void* block, u64 bytes)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_sites[tracking_header(block)->site].stats.bytes_copied += bytes;
+		m_totals.bytes_copied += bytes;
+	}
+
+	m_inner.note_copy(tracking_header(block), bytes);
+}
+
+AllocatorStats TrackingAllocator::stats() const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	AllocatorStats stats = m_totals;
+	stats.bytes_reserved = stats.bytes_live + (stats.allocs - stats.frees) * HEADER_SIZE;
+	return stats;
+}
+
+void TrackingAllocator::dump(FILE* file) const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+
+	u32 order[MAX_SITES];
+	u32 count = 0;
+	for (u32 i = 0; i < MAX_SITES; ++i)
+	{
+		if (m_sites[i].stats.allocs)
+			order[count++] = i;
+	}
+	std::sort(order, order + count, [this](u32 a, u32 b) {
+		return m_sites[a].stats.bytes_requested > m_sites[b].stats.bytes_requested;
+	});
+
+	void* addresses[MAX_SITES];
+	for (u32 i = 0; i < count; ++i)
+	{
+		addresses[i] = (void*)m_sites[order[i]].address;
+	}
+
+#if defined(__GLIBC__)
+	char** symbols = count ? backtrace_symbols(addresses, (int)count) : nullptr;
+#else
+	char** symbols = nullptr;
+#endif
+
+	fprintf(file, "%10s %10s %8s %14s %14s %14s %14s  site\n", "allocs", "frees", "expands", "requested", "live", "peak", "copied");
+	for (u32 i = 0; i < count; ++i)
+	{
+		const AllocatorStats& s = m_sites[order[i]].stats;
+		fprintf(file, "%10llu %10llu %8llu %14llu %14llu %14llu %14llu  ", s.allocs, s.frees, s.expands,
+			s.bytes_requested, s.bytes_live, s.bytes_peak, s.bytes_copied);
+
+		if (order[i] == 0)
+			fprintf(file, "other\n");
+		else if (symbols)
+			fprintf(file, "%s\n", symbols[i]);
+		else
+			fprintf(file, "%p\n", addresses[i]);
+	}
+
+	const AllocatorStats& t = m_totals;
+	fprintf(file, "%10llu %10llu %8llu %14llu %14llu %14llu %14llu  total\n", t.allocs, t.frees, t.expands,
+		t.bytes_requested, t.bytes_live, t.bytes_peak, t.bytes_copied);
+
+	::free(symbols);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdio>
+#include <mutex>
+
+#include "Array.h"
+#include "Core.h"
+
+// Forwards to another allocator and records every call by the code address it came from. A 16 byte
+// header in front of each block remembers that site, so frees, growth and copies are charged to
+// whoever allocated the block. Calls take one uncontended lock and a probe into a fixed site table.
+class TrackingAllocator : public Allocator
+{
+public:
+	explicit TrackingAllocator(Allocator& inner);
+	~TrackingAllocator() override = default;
+
+	TrackingAllocator(const TrackingAllocator&) = delete;
+	TrackingAllocator& operator=(const TrackingAllocator&) = delete;
+
+	void* alloc(u64 size) override;
+	void free(void* block, u64 size) override;
+	void* try_expand(void* block, u64 size, u64 newSize) override;
+	void note_copy(void* block, u64 bytes) override;
+
+	// Totals over all sites, reserved adds the headers.
+	AllocatorStats stats() const override;
+
+	// One line per site, most bytes requested first. Sites are symbolized where the platform can.
+	void dump(FILE* file = stdout) const;
+
+private:
+	struct Site
+	{
+		const void* address;
+		AllocatorStats stats;
+	};
+
+	// Power of 2. Once three quarters are taken new sites are charged to slot 0, printed as other.
+	static constexpr u32 MAX_SITES = 1024;
+
+	u32 find_site(const void* address);
+
+	Allocator& m_inner;
+	mutable std::mutex m_lock;
+	AllocatorStats m_totals;
+	u32 m_siteCount;
+	Site m_sites[MAX_SITES];
+};
@@ -1,6 +1,8 @@
 #include <cstdio>
 
 #include "Array.h"
+#include "Benchmark.h"
+#include "SmallArray.h"
 #include "SwissTable.h"
 #include "ScratchAllocator.h"
 #include "Timer.h"
@@ -17,7 +19,7 @@ constexpr const char* test_string = "long streng som moste allokere minne";
 
 auto fill_swiss(int n)
 {
-	SwissTable<Test> hash;
+	SwissTable<u64, Test> hash;
 
 	for (int i = 0; i < n;++i)
 	{
@@ -27,22 +29,18 @@ auto fill_swiss(int n)
 	return hash;
 }
 
-auto accumulate_swiss(const SwissTable<Test>& in)
+auto accumulate_swiss(const SwissTable<u64, Test>& in)
 {
 	u64 sum = 0;
-	for (u32 i = 0; i < in.capacity; ++i)
+	for (auto& v : in)
 	{
-		if (in.control[i] != DELETED && in.control[i] != EMPTY)
-		{
-			auto& v = in.data[i];
-			sum += v.value.health + strlen(v.value.name);
-		}
+		sum += v.value.health + strlen(v.value.name);
 	}
 	return sum;
 }
 
 	
-auto accumulate_swiss_rand(SwissTable<Test>& in)
+auto accumulate_swiss_rand(SwissTable<u64, Test>& in)
 {
 	u64 sum = 0;
 
@@ -56,9 +54,9 @@ auto accumulate_swiss_rand(SwissTable<Test>& in)
 	return sum;
 }
 
-void copy_swiss(SwissTable<Test>& in)
+void copy_swiss(SwissTable<u64, Test>& in)
 {
-	SwissTable<Test> v;
+	SwissTable<u64, Test> v;
 	for (int i = 0; i < 1; ++i)
 	{
 		v = in;
@@ -68,7 +66,7 @@ void copy_swiss(SwissTable<Test>& in)
 }
 
 bool testSwissTable() {
-    SwissTable<int> table;
+    SwissTable<u64, int> table;
 
     // Insert and Find Test
     table.insert(1, 100);
@@ -179,11 +177,12 @@ bool testArray(Allocator& a)
 	return true;
 }
 
-void fill_array_and_sum(Array<Array<char>>& arr, Allocator& a)
+template<typename Record>
+void fill_array_and_sum(Array<Record>& arr, Allocator& a)
 {
 	for (int i = 0; i < 100000; ++i)
 	{
-		arr.push_back(Array<char>(a));
+		arr.emplace_back(a);
 
 		auto& ins = arr.back();
 
@@ -196,37 +195,52 @@ void fill_array_and_sum(Array<Array<char>>& arr, Allocator& a)
 
 
 
-int main()
+int main(int argc, char** argv)
 {
+	const char* jsonPath = nullptr;
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (strcmp(argv[i], "--json") == 0)
+			jsonPath = argv[i + 1];
+	}
+
 	MallocAllocator ma;
 	puts("Init memory");
 	block_memory_init();
 	{
-		Timer t;
-		timer_init(&t);
-
-		
-		for (int i = 0; i < 1; ++i)
+		Array<BenchResult> results(ma);
+
+		results.push_back(bench_run("fill array malloc", 100000, [&] {
+			Array<Array<char>> arra(ma);
+			fill_array_and_sum(arra, ma);
+		}));
+
+		// Each inner array is the newest allocation while it fills, so it grows in place.
+		results.push_back(bench_run("fill array scratch", 100000, [] {
+			ScratchPadAllocator sa;
+			Array<Array<char>> arrb(sa);
+			fill_array_and_sum(arrb, sa);
+		}));
+
+		// The first 16 chars of every record are inline, growth only allocates from 32 on.
+		results.push_back(bench_run("fill small array malloc", 100000, [&] {
+			Array<SmallArray<char, 16>> arrc(ma);
+			fill_array_and_sum(arrc, ma);
+		}));
+
+		for (const BenchResult& r : results)
 		{
-			timer_start(&t);
-			{
-				Array<Array<char>> arra(ma);
-				fill_array_and_sum(arra, ma);
-			}
-			timer_elapsed_ms(&t);
-			printf("Fill array malloc took %f ms\n", timer_elapsed_ms(&t));
+			bench_print(r);
+		}
 
-			timer_start(&t);
+		if (jsonPath)
+		{
+			FILE* f = fopen(jsonPath, "w");
+			if (f)
 			{
-				ScratchPadAllocator sa;
-				void* t1 = sa.alloc(Block::BLOCK_SIZE / 2);
-				void* t2 = sa.alloc(Block::BLOCK_SIZE / 2);
-				/*using Str = Array<Array<char>>;
-				Array<Array<char>>* arrb = new(sa.alloc(sizeof(Str))) Str(sa);
-				fill_array_and_sum(*arrb, sa);*/
+				bench_write_json(f, results.begin(), results.size());
+				fclose(f);
 			}
-			timer_elapsed_ms(&t);
-			printf("Fill array scratch took %f ms\n", timer_elapsed_ms(&t));
 		}
 	}
 
@@ -235,4 +249,3 @@ int main()
 	puts("memory shutdown");
 }
 
-
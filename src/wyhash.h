@@ -3,6 +3,10 @@
 #include <cstdint>
 #include <cstring>
 
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 using u8 = unsigned char;
 using u32 = unsigned int;
 using u64 = unsigned long long;
@@ -112,8 +116,153 @@ inline u64 hash(void const* key, size_t len)
     return mix(secret[1] ^ len, mix(a ^ secret[1], b ^ seed));
 }
 
+static constexpr u64 KEY_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+
 inline u64 hash(u64 x){
-    return wyhash::mix(x, 0x9E3779B97F4A7C15ULL);
+    return wyhash::mix(x, KEY_MULTIPLIER);
+}
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+// No 64x64->128 multiply in AVX2 or AVX-512, the product is put together from four 32x32->64
+// ones. The middle sum stays below 2^34 so no carries have to be tracked. The kv_ wrappers let
+// one body serve both widths.
+#if defined(__AVX512F__)
+using KeyVector = __m512i;
+static constexpr size_t KEY_LANES = 8;
+inline KeyVector kv_load(const u64* p) { return _mm512_loadu_si512(p); }
+inline void kv_store(u64* p, KeyVector v) { _mm512_storeu_si512(p, v); }
+inline KeyVector kv_set1(u64 x) { return _mm512_set1_epi64((long long)x); }
+inline KeyVector kv_mul32(KeyVector a, KeyVector b) { return _mm512_mul_epu32(a, b); }
+inline KeyVector kv_srli(KeyVector a, int n) { return _mm512_srli_epi64(a, (unsigned)n); }
+inline KeyVector kv_slli(KeyVector a, int n) { return _mm512_slli_epi64(a, (unsigned)n); }
+inline KeyVector kv_add(KeyVector a, KeyVector b) { return _mm512_add_epi64(a, b); }
+inline KeyVector kv_and(KeyVector a, KeyVector b) { return _mm512_and_si512(a, b); }
+inline KeyVector kv_xor(KeyVector a, KeyVector b) { return _mm512_xor_si512(a, b); }
+#else
+using KeyVector = __m256i;
+static constexpr size_t KEY_LANES = 4;
+inline KeyVector kv_load(const u64* p) { return _mm256_loadu_si256((const __m256i*)p); }
+inline void kv_store(u64* p, KeyVector v) { _mm256_storeu_si256((__m256i*)p, v); }
+inline KeyVector kv_set1(u64 x) { return _mm256_set1_epi64x((long long)x); }
+inline KeyVector kv_mul32(KeyVector a, KeyVector b) { return _mm256_mul_epu32(a, b); }
+inline KeyVector kv_srli(KeyVector a, int n) { return _mm256_srli_epi64(a, n); }
+inline KeyVector kv_slli(KeyVector a, int n) { return _mm256_slli_epi64(a, n); }
+inline KeyVector kv_add(KeyVector a, KeyVector b) { return _mm256_add_epi64(a, b); }
+inline KeyVector kv_and(KeyVector a, KeyVector b) { return _mm256_and_si256(a, b); }
+inline KeyVector kv_xor(KeyVector a, KeyVector b) { return _mm256_xor_si256(a, b); }
+#endif
+
+inline KeyVector hash_lanes(KeyVector x) {
+    const KeyVector lo32 = kv_set1(0xFFFFFFFFULL);
+    const KeyVector cl = kv_set1(KEY_MULTIPLIER & 0xFFFFFFFFULL);
+    const KeyVector ch = kv_set1(KEY_MULTIPLIER >> 32U);
+    const KeyVector xh = kv_srli(x, 32);
+
+    const KeyVector ll = kv_mul32(x, cl);
+    const KeyVector lh = kv_mul32(x, ch);
+    const KeyVector hl = kv_mul32(xh, cl);
+    const KeyVector hh = kv_mul32(xh, ch);
+
+    const KeyVector mid = kv_add(kv_srli(ll, 32), kv_add(kv_and(lh, lo32), kv_and(hl, lo32)));
+    const KeyVector lo = kv_add(kv_slli(mid, 32), kv_and(ll, lo32));
+    const KeyVector hi = kv_add(kv_add(hh, kv_srli(mid, 32)), kv_add(kv_srli(lh, 32), kv_srli(hl, 32)));
+    return kv_xor(lo, hi);
+}
+#endif
+
+// out[i] = hash(in[i]). The scalar loop already lets the CPU overlap independent multiplies,
+// the vector path trades one 64 bit multiply for four 32 bit ones per lane.
+inline void hash_many(const u64* in, u64* out, size_t n) {
+    size_t i = 0;
+#if defined(__AVX512F__) || defined(__AVX2__)
+    for (; i + KEY_LANES <= n; i += KEY_LANES) {
+        kv_store(out + i, hash_lanes(kv_load(in + i)));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = hash(in[i]);
+    }
+}
+
+// Compile time variant of hash(const void*, size_t) for literals and other constant strings,
+// gives the same value as the runtime one on little endian targets.
+namespace detail {
+
+constexpr u64 cmix(u64 a, u64 b) {
+    u64 ha = a >> 32U;
+    u64 hb = b >> 32U;
+    u64 la = a & 0xFFFFFFFFULL;
+    u64 lb = b & 0xFFFFFFFFULL;
+    u64 rh = ha * hb;
+    u64 rm0 = ha * lb;
+    u64 rm1 = hb * la;
+    u64 rl = la * lb;
+    u64 t = rl + (rm0 << 32U);
+    u64 c = t < rl;
+    u64 lo = t + (rm1 << 32U);
+    c += lo < t;
+    u64 hi = rh + (rm0 >> 32U) + (rm1 >> 32U) + c;
+    return lo ^ hi;
+}
+
+constexpr u64 cr(const char* p, size_t n) {
+    u64 v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        v |= static_cast<u64>(static_cast<u8>(p[i])) << (8U * i);
+    }
+    return v;
+}
+
+} // namespace detail
+
+constexpr u64 hash_constexpr(const char* p, size_t len) {
+    constexpr u64 secret[4]{
+        0xa0761d6478bd642fULL,
+        0xe7037ed1a0b428dbULL,
+        0x8ebc6af09c88c6e3ULL,
+        0x589965cc75374cc3ULL
+    };
+
+    u64 seed = secret[0];
+    u64 a = 0;
+    u64 b = 0;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (detail::cr(p, 4) << 32U) | detail::cr(p + ((len >> 3U) << 2U), 4);
+            b = (detail::cr(p + len - 4, 4) << 32U) | detail::cr(p + len - 4 - ((len >> 3U) << 2U), 4);
+        } else if (len > 0) {
+            a = (static_cast<u64>(static_cast<u8>(p[0])) << 16U) | (static_cast<u64>(static_cast<u8>(p[len >> 1U])) << 8U) | static_cast<u8>(p[len - 1]);
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            u64 see1 = seed;
+            u64 see2 = seed;
+            do {
+                seed = detail::cmix(detail::cr(p, 8) ^ secret[1], detail::cr(p + 8, 8) ^ seed);
+                see1 = detail::cmix(detail::cr(p + 16, 8) ^ secret[2], detail::cr(p + 24, 8) ^ see1);
+                see2 = detail::cmix(detail::cr(p + 32, 8) ^ secret[3], detail::cr(p + 40, 8) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = detail::cmix(detail::cr(p, 8) ^ secret[1], detail::cr(p + 8, 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = detail::cr(p + i - 16, 8);
+        b = detail::cr(p + i - 8, 8);
+    }
+
+    return detail::cmix(secret[1] ^ len, detail::cmix(a ^ secret[1], b ^ seed));
+}
+
+// hash_literal("config/root") is folded to a constant, the terminator is not hashed.
+template<size_t N>
+constexpr u64 hash_literal(const char (&str)[N]) {
+    return hash_constexpr(str, N - 1);
 }
 
 } // namespace wyhash
\ No newline at end of file